@@ -0,0 +1,176 @@
+'''
+Compare the labels and centroids of TwoDKMeansMPI with --precision single
+against the double precision run on the same data set and seeds.
+
+For every dimension and k a binary data set of points drawn around
+TRUE_CLUSTERS centers is generated (see src/mpi/dataset.h) and clustered
+twice, seeded with --init random so that both runs start from the same
+points. Every single precision cluster is matched with the double
+precision cluster most of its rows went to; the fraction of rows whose
+matched label agrees and the largest coordinate difference of the matched
+centroids are printed. An agreement below the threshold or a centroid
+difference above the tolerance makes the script exit with status 1.
+
+The default k stays at the number of generated clusters: far above it the
+clusters split along near ties, and a single row that float rounding puts
+on the other side can lead the two runs to different local optima.
+
+Python 2 and 3, no modules beyond the standard library.
+'''
+from __future__ import print_function
+
+import sys
+import os
+import getopt
+import random
+import struct
+import subprocess
+
+# the binary data set header: magic, version, element type, dimension, rows, reserved
+HEADER = '<4siiiqq'
+FLOAT64 = 1
+
+# the clusters the generated data is drawn around
+TRUE_CLUSTERS = 16
+
+
+def usage():
+    print('$> python compareprecision.py [optional args]\n' +
+          '\t-B <dir>\tDirectory holding TwoDKMeansMPI [../mpi]\n' +
+          '\t-w <dir>\tDirectory for the generated data sets and outputs [precisiondata]\n' +
+          '\t-n <ranks>\tRank count [2]\n' +
+          '\t-s <rows>\tRows of every data set [20000]\n' +
+          '\t-k <k>\t\tComma separated cluster counts [8,16]\n' +
+          '\t-d <dims>\tComma separated dimensions [2,8,33]\n' +
+          '\t-x <options>\tExtra driver options, e.g. "--threads 2"\n' +
+          '\t-a <fraction>\tLowest label agreement that passes [0.999]\n' +
+          '\t-c <distance>\tLargest centroid coordinate difference that passes [0.01]\n')
+
+
+def intList(value):
+    return [int(item) for item in value.split(',') if item]
+
+
+def handleArgs(args):
+    settings = {
+        'bin': os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'mpi'),
+        'work': 'precisiondata',
+        'ranks': 2,
+        'rows': 20000,
+        'k': [8, 16],
+        'dimensions': [2, 8, 33],
+        'extra': [],
+        'agreement': 0.999,
+        'tolerance': 0.01,
+    }
+    try:
+        optlist, args = getopt.getopt(args[1:], 'B:w:n:s:k:d:x:a:c:h')
+    except getopt.GetoptError as err:
+        print(str(err))
+        usage()
+        sys.exit(2)
+
+    for key, val in optlist:
+        if key == '-B':
+            settings['bin'] = val
+        elif key == '-w':
+            settings['work'] = val
+        elif key == '-n':
+            settings['ranks'] = int(val)
+        elif key == '-s':
+            settings['rows'] = int(val)
+        elif key == '-k':
+            settings['k'] = intList(val)
+        elif key == '-d':
+            settings['dimensions'] = intList(val)
+        elif key == '-x':
+            settings['extra'] = val.split()
+        elif key == '-a':
+            settings['agreement'] = float(val)
+        elif key == '-c':
+            settings['tolerance'] = float(val)
+        else:
+            usage()
+            sys.exit()
+    return settings
+
+
+def writePoints(path, rows, dimension):
+    '''
+    Writes rows points drawn around TRUE_CLUSTERS random centers as a
+    binary data set of doubles.
+    '''
+    generator = random.Random(rows * 131 + dimension)
+    centers = [[generator.uniform(0, 10) for d in range(dimension)] for c in range(TRUE_CLUSTERS)]
+    row = struct.Struct('<%dd' % dimension)
+    with open(path, 'wb') as output:
+        output.write(struct.pack(HEADER, b'KMDS', 1, FLOAT64, dimension, rows, 0))
+        for i in range(rows):
+            center = centers[generator.randrange(TRUE_CLUSTERS)]
+            output.write(row.pack(*[generator.gauss(value, 0.5) for value in center]))
+
+
+def runDriver(settings, path, k, precision):
+    '''
+    Runs the driver and returns the labels and centroids it writes.
+    '''
+    prefix = '%s-%d-%s' % (os.path.splitext(path)[0], k, precision)
+    command = ['mpirun', '--oversubscribe', '-np', str(settings['ranks'])]
+    if hasattr(os, 'geteuid') and os.geteuid() == 0:
+        command.insert(1, '--allow-run-as-root')
+    command += [os.path.join(settings['bin'], 'TwoDKMeansMPI'), path, str(k), '--init', 'random',
+                '--precision', precision, '--labels', prefix + '.labels',
+                '--centroids', prefix + '.centroids'] + settings['extra']
+    subprocess.check_output(command)
+
+    with open(prefix + '.labels') as source:
+        labels = [int(line) for line in source if line.strip()]
+    with open(prefix + '.centroids') as source:
+        centroids = [[float(value) for value in line.split(',')] for line in source if line.strip()]
+    return labels, centroids
+
+
+def compare(double, single, k):
+    '''
+    Returns the label agreement and the largest centroid difference, every
+    single precision cluster matched with the double one most of its rows
+    went to.
+    '''
+    doubleLabels, doubleCentroids = double
+    singleLabels, singleCentroids = single
+    counts = [[0] * k for c in range(k)]
+    for a, b in zip(doubleLabels, singleLabels):
+        counts[b][a] += 1
+    match = [max(range(k), key=lambda a: counts[b][a]) for b in range(k)]
+
+    agreement = sum(1 for a, b in zip(doubleLabels, singleLabels) if match[b] == a) / float(len(doubleLabels))
+    difference = 0.0
+    for b in range(k):
+        # a cluster no row went to keeps its seed in both runs
+        if sum(counts[b]) == 0:
+            continue
+        for x, y in zip(doubleCentroids[match[b]], singleCentroids[b]):
+            difference = max(difference, abs(x - y))
+    return agreement, difference
+
+
+settings = handleArgs(sys.argv)
+if not os.path.isdir(settings['work']):
+    os.makedirs(settings['work'])
+problems = []
+for dimension in settings['dimensions']:
+    path = os.path.join(settings['work'], '2d-%d-%d.bin' % (settings['rows'], dimension))
+    if not os.path.exists(path):
+        writePoints(path, settings['rows'], dimension)
+    for k in settings['k']:
+        agreement, difference = compare(runDriver(settings, path, k, 'double'),
+                                        runDriver(settings, path, k, 'single'), k)
+        print('dim %4d k %4d: %.6f of the labels agree, centroids differ by up to %.3g' %
+              (dimension, k, agreement, difference))
+        if agreement < settings['agreement'] or difference > settings['tolerance']:
+            problems.append('dim %d k %d: agreement %.6f, centroid difference %.3g' %
+                            (dimension, k, agreement, difference))
+for problem in problems:
+    print(problem)
+if problems:
+    sys.exit(1)
@@ -0,0 +1,302 @@
+'''
+Strong and weak scaling runs of TwoDKMeansMPI and DNAKMeansMPI on one
+machine, with mpirun --oversubscribe.
+
+For every kind (2d, dna), mode (strong, weak), rank count, data set size,
+k and dimension the drivers are run on a generated binary data set (see
+src/mpi/dataset.h). The iteration count and the time of the k-means phase
+they print are recorded with the time per iteration, the throughput in
+points * centroids / second and the parallel efficiency against one rank.
+The results are written to <output>.csv and <output>.json.
+
+With -b the results are compared with a baseline CSV written by an
+earlier run: a throughput more than the tolerance below the baseline is a
+regression, an efficiency below the cliff threshold is a scaling cliff.
+Either makes the script exit with status 1.
+
+Python 2 and 3, no modules beyond the standard library.
+'''
+from __future__ import print_function
+
+import sys
+import os
+import csv
+import json
+import getopt
+import random
+import struct
+import subprocess
+import time
+
+# the columns of the CSV output, in order
+COLUMNS = ['kind', 'mode', 'ranks', 'rows', 'k', 'dimension', 'iterations',
+           'seconds', 'secondsPerIteration', 'throughput', 'efficiency']
+
+# the binary data set header: magic, version, element type, dimension, rows, reserved
+HEADER = '<4siiiqq'
+FLOAT64 = 1
+DNA2BIT = 2
+BASES_PER_WORD = 32
+
+# the clusters the generated data is drawn around
+TRUE_CLUSTERS = 16
+
+
+def usage():
+    print('$> python runbench.py [optional args]\n' +
+          '\t-B <dir>\tDirectory holding TwoDKMeansMPI and DNAKMeansMPI [../mpi]\n' +
+          '\t-o <prefix>\tWrite the results to <prefix>.csv and <prefix>.json [bench]\n' +
+          '\t-w <dir>\tDirectory for the generated data sets [benchdata]\n' +
+          '\t-t <kinds>\tComma separated kinds: 2d,dna [2d,dna]\n' +
+          '\t-m <modes>\tComma separated modes: strong,weak [strong,weak]\n' +
+          '\t-n <ranks>\tComma separated rank counts [1,2,4]\n' +
+          '\t-s <rows>\tComma separated sizes, total rows for strong scaling\n' +
+          '\t\t\tand rows per rank for weak scaling [20000]\n' +
+          '\t-k <k>\t\tComma separated cluster counts [8,64]\n' +
+          '\t-d <dims>\tComma separated dimensions of the 2d kind [2,8]\n' +
+          '\t-l <lengths>\tComma separated strand lengths of the dna kind [100]\n' +
+          '\t-r <#>\t\tRepeats per configuration, the fastest is kept [1]\n' +
+          '\t-x <options>\tExtra driver options, e.g. "--prune auto --threads 2"\n' +
+          '\t-b <file>\tBaseline CSV to compare with\n' +
+          '\t-T <fraction>\tThroughput drop counted as a regression [0.15]\n' +
+          '\t-e <fraction>\tEfficiency below which scaling is a cliff [0.5]\n')
+
+
+def intList(value):
+    return [int(item) for item in value.split(',') if item]
+
+
+def handleArgs(args):
+    settings = {
+        'bin': os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'mpi'),
+        'output': 'bench',
+        'work': 'benchdata',
+        'kinds': ['2d', 'dna'],
+        'modes': ['strong', 'weak'],
+        'ranks': [1, 2, 4],
+        'sizes': [20000],
+        'k': [8, 64],
+        'dimensions': [2, 8],
+        'lengths': [100],
+        'repeats': 1,
+        'extra': [],
+        'baseline': None,
+        'tolerance': 0.15,
+        'cliff': 0.5,
+    }
+    try:
+        optlist, args = getopt.getopt(args[1:], 'B:o:w:t:m:n:s:k:d:l:r:x:b:T:e:h')
+    except getopt.GetoptError as err:
+        print(str(err))
+        usage()
+        sys.exit(2)
+
+    for key, val in optlist:
+        if key == '-B':
+            settings['bin'] = val
+        elif key == '-o':
+            settings['output'] = val
+        elif key == '-w':
+            settings['work'] = val
+        elif key == '-t':
+            settings['kinds'] = val.split(',')
+        elif key == '-m':
+            settings['modes'] = val.split(',')
+        elif key == '-n':
+            settings['ranks'] = intList(val)
+        elif key == '-s':
+            settings['sizes'] = intList(val)
+        elif key == '-k':
+            settings['k'] = intList(val)
+        elif key == '-d':
+            settings['dimensions'] = intList(val)
+        elif key == '-l':
+            settings['lengths'] = intList(val)
+        elif key == '-r':
+            settings['repeats'] = int(val)
+        elif key == '-x':
+            settings['extra'] = val.split()
+        elif key == '-b':
+            settings['baseline'] = val
+        elif key == '-T':
+            settings['tolerance'] = float(val)
+        elif key == '-e':
+            settings['cliff'] = float(val)
+        else:
+            usage()
+            sys.exit()
+
+    for kind in settings['kinds']:
+        if kind not in ('2d', 'dna'):
+            usage()
+            sys.exit()
+    for mode in settings['modes']:
+        if mode not in ('strong', 'weak'):
+            usage()
+            sys.exit()
+    return settings
+
+
+def writePoints(path, rows, dimension):
+    '''
+    Writes rows points drawn around TRUE_CLUSTERS random centers as a
+    binary data set of doubles.
+    '''
+    generator = random.Random(rows * 131 + dimension)
+    centers = [[generator.uniform(0, 10) for d in range(dimension)] for c in range(TRUE_CLUSTERS)]
+    row = struct.Struct('<%dd' % dimension)
+    with open(path, 'wb') as output:
+        output.write(struct.pack(HEADER, b'KMDS', 1, FLOAT64, dimension, rows, 0))
+        for i in range(rows):
+            center = centers[generator.randrange(TRUE_CLUSTERS)]
+            output.write(row.pack(*[generator.gauss(value, 0.5) for value in center]))
+
+
+def writeStrands(path, rows, length):
+    '''
+    Writes rows strands, each a random center strand with about a tenth
+    of its bases changed, as a binary data set packed at 2 bits per base.
+    '''
+    generator = random.Random(rows * 137 + length)
+    centers = [[generator.randrange(4) for j in range(length)] for c in range(TRUE_CLUSTERS)]
+    words = (length + BASES_PER_WORD - 1) // BASES_PER_WORD
+    row = struct.Struct('<%dQ' % words)
+    with open(path, 'wb') as output:
+        output.write(struct.pack(HEADER, b'KMDS', 1, DNA2BIT, length, rows, 0))
+        for i in range(rows):
+            center = centers[generator.randrange(TRUE_CLUSTERS)]
+            packed = [0] * words
+            for j in range(length):
+                base = center[j] if generator.random() >= 0.1 else generator.randrange(4)
+                packed[j // BASES_PER_WORD] |= base << (2 * (j % BASES_PER_WORD))
+            output.write(row.pack(*packed))
+
+
+def dataset(settings, kind, rows, dimension):
+    '''
+    The path of the generated data set, written on first use.
+    '''
+    if not os.path.isdir(settings['work']):
+        os.makedirs(settings['work'])
+    path = os.path.join(settings['work'], '%s-%d-%d.bin' % (kind, rows, dimension))
+    if not os.path.exists(path):
+        if kind == '2d':
+            writePoints(path, rows, dimension)
+        else:
+            writeStrands(path, rows, dimension)
+    return path
+
+
+def runDriver(settings, kind, ranks, path, k):
+    '''
+    Runs one driver and returns the iterations and the seconds of the
+    k-means phase it reports, the fastest of the repeats.
+    '''
+    driver = os.path.join(settings['bin'], 'TwoDKMeansMPI' if kind == '2d' else 'DNAKMeansMPI')
+    command = ['mpirun', '--oversubscribe', '-np', str(ranks)]
+    if hasattr(os, 'geteuid') and os.geteuid() == 0:
+        command.insert(1, '--allow-run-as-root')
+    command += [driver, path, str(k)] + settings['extra']
+
+    best = None
+    for repeat in range(settings['repeats']):
+        output = subprocess.check_output(command).decode('utf-8', 'replace')
+        iterations = None
+        seconds = None
+        for line in output.splitlines():
+            if line.startswith('K-Means converged after'):
+                iterations = int(line.split()[3])
+            elif line.startswith('K-Means took'):
+                seconds = float(line.split()[2])
+        if iterations is None or seconds is None:
+            print(output)
+            raise RuntimeError('no timing in the output of ' + ' '.join(command))
+        if best is None or seconds < best[1]:
+            best = (iterations, seconds)
+    return best
+
+
+def runMatrix(settings):
+    results = []
+    for kind in settings['kinds']:
+        dimensions = settings['dimensions'] if kind == '2d' else settings['lengths']
+        for mode in settings['modes']:
+            for size in settings['sizes']:
+                for dimension in dimensions:
+                    for k in settings['k']:
+                        single = None
+                        for ranks in settings['ranks']:
+                            rows = size if mode == 'strong' else size * ranks
+                            path = dataset(settings, kind, rows, dimension)
+                            iterations, seconds = runDriver(settings, kind, ranks, path, k)
+                            perIteration = seconds / max(iterations, 1)
+                            result = {
+                                'kind': kind, 'mode': mode, 'ranks': ranks, 'rows': rows,
+                                'k': k, 'dimension': dimension, 'iterations': iterations,
+                                'seconds': seconds, 'secondsPerIteration': perIteration,
+                                'throughput': rows * k / perIteration if perIteration > 0 else 0.0,
+                                'efficiency': None,
+                            }
+                            # the efficiency compares the time per iteration, so differing iteration counts do not count
+                            if ranks == 1:
+                                single = perIteration
+                            if single is not None and perIteration > 0:
+                                if mode == 'strong':
+                                    result['efficiency'] = single / (ranks * perIteration)
+                                else:
+                                    result['efficiency'] = single / perIteration
+                            results.append(result)
+                            print('%-3s %-6s ranks %2d rows %8d k %4d dim %4d: %3d iterations, '
+                                  '%.4f s/iteration, %.3g points*centroids/s' %
+                                  (kind, mode, ranks, rows, k, dimension, iterations, perIteration,
+                                   result['throughput']))
+    return results
+
+
+def key(result):
+    return (result['kind'], result['mode'], int(result['ranks']), int(result['rows']),
+            int(result['k']), int(result['dimension']))
+
+
+def compare(settings, results):
+    '''
+    Returns the regressions against the baseline and the scaling cliffs.
+    '''
+    problems = []
+    if settings['baseline'] is not None:
+        with open(settings['baseline']) as source:
+            baseline = dict((key(row), row) for row in csv.DictReader(source))
+        for result in results:
+            reference = baseline.get(key(result))
+            if reference is None:
+                continue
+            expected = float(reference['throughput'])
+            if result['throughput'] < expected * (1 - settings['tolerance']):
+                problems.append('regression: %s %s ranks %d rows %d k %d dim %d at %.3g, baseline %.3g' %
+                                (key(result) + (result['throughput'], expected)))
+    for result in results:
+        if result['efficiency'] is not None and result['ranks'] > 1 and result['efficiency'] < settings['cliff']:
+            problems.append('scaling cliff: %s %s ranks %d rows %d k %d dim %d at efficiency %.2f' %
+                            (key(result) + (result['efficiency'],)))
+    return problems
+
+
+def writeResults(settings, results):
+    with open(settings['output'] + '.csv', 'w') as output:
+        writer = csv.writer(output)
+        writer.writerow(COLUMNS)
+        for result in results:
+            writer.writerow(['' if result[column] is None else result[column] for column in COLUMNS])
+    with open(settings['output'] + '.json', 'w') as output:
+        json.dump({'date': time.strftime('%Y-%m-%dT%H:%M:%S'), 'extra': settings['extra'],
+                   'results': results}, output, indent=1)
+
+
+settings = handleArgs(sys.argv)
+results = runMatrix(settings)
+writeResults(settings, results)
+problems = compare(settings, results)
+for problem in problems:
+    print(problem)
+if problems:
+    sys.exit(1)
@@ -1,14 +1,164 @@
 #include "mpi.h"
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include "Util.h"
+#include "dnapack.h"
+#include "dataio.h"
+#include "dnakmeans.h"
+#include "seeding.h"
+#include "timing.h"
+#include "restarts.h"
+#include "editkmeans.h"
+
+
+/*
+ * --sweep: k-means for every k of options->sweep on the strands loaded once.
+ * The master seeds with k-means++ among one set of candidate strands, a k
+ * at least as large as the one before keeps its centroids and only draws
+ * the new ones. Prints the cost, the mean simplified silhouette, the
+ * iterations and the time of each k.
+ */
+static void sweepClusters(MPI_Comm comm, uint64_t** rows, int* handleRows, int firstRow, int lineNums, int dimension,
+                          const KMeansOptions* options) {
+    int rank;
+    int largest = 1;
+    int previous = 0;
+    int candidateNums;
+    int* candidates;
+    int s;
+    int words = packedWords(dimension);
+    int rowBytes = sizeof(uint64_t) * words;
+    
+    MPI_Comm_rank(comm, &rank);
+    for (s = 0; s < options->sweepNums; s++) {
+        largest = max(largest, options->sweep[s]);
+    }
+    candidates = seedCandidates(lineNums, largest, &candidateNums);
+    uint64_t* candidateRows = malloc((size_t)candidateNums * rowBytes);
+    uint64_t* centroids = malloc((size_t)largest * rowBytes);
+    int* categories = malloc(sizeof(int) * max(*handleRows, 1));
+    MPI_Bcast(candidates, candidateNums, MPI_INT, 0, comm);
+    fetchRows(comm, 0, candidates, candidateNums, *rows, firstRow, *handleRows, rowBytes, candidateRows);
+    
+    if (rank == 0) {
+        printf("%8s %16s %11s %11s %10s\n", "k", "Hamming distance", "silhouette", "iterations", "seconds");
+    }
+    for (s = 0; s < options->sweepNums; s++) {
+        int cluster = options->sweep[s];
+        KMeansOptions resolved = *options;
+        double local[2], total[2];
+        double seconds = MPI_Wtime();
+        int iterations;
+        
+        resolveOptions(&resolved, cluster);
+        if (rank == 0 && previous > 0 && previous <= cluster) {
+            extendSeeds(candidateRows, NULL, candidateNums, rowBytes, words, dnaSeedDistance, previous, cluster, centroids);
+        } else if (rank == 0) {
+            kmeansPlusPlus(candidateRows, NULL, candidateNums, rowBytes, words, dnaSeedDistance, cluster, centroids);
+        }
+        MPI_Bcast(centroids, cluster * words, MPI_UINT64_T, 0, comm);
+        iterations = dnaKMeans(comm, rows, handleRows, dimension, cluster, &resolved, centroids, &categories);
+        
+        local[0] = dnaCost(*rows, *handleRows, dimension, centroids, categories);
+        local[1] = dnaSilhouette(*rows, *handleRows, dimension, centroids, cluster, categories);
+        MPI_Reduce(local, total, 2, MPI_DOUBLE, MPI_SUM, 0, comm);
+        seconds = MPI_Wtime() - seconds;
+        if (rank == 0) {
+            printf("%8d %16.9g %11.6f %11d %10.4f\n", cluster, total[0], total[1] / lineNums, iterations, seconds);
+        }
+        previous = cluster;
+    }
+    
+    free(candidates);
+    free(candidateRows);
+    free(centroids);
+    free(categories);
+}
+
+/*
+ * --variable-length: read strands of any length, cluster them by edit
+ * distance around medoids (see editkmeans.h) and write or gather the
+ * labels and the medoids as the fixed length run does. expected is the
+ * number of strands given on the command line, 0 if none was given.
+ */
+static void clusterStrands(MPI_Comm comm, const char* filename, int expected, int cluster,
+                           const KMeansOptions* options) {
+    int rank, numprocs;
+    int handleRows;
+    int firstRow = 0;
+    int lineNums;
+    int iterations;
+    double cost;
+    double kmeansTime;
+    int i;
+    
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numprocs);
+    
+    beginPhase(PHASE_READ);
+    StrandArena* strands = readStrandPartition(comm, filename);
+    handleRows = strands->count;
+    int* sendcounts = malloc(sizeof(int) * numprocs);
+    int* displs = malloc(sizeof(int) * numprocs);
+    MPI_Allgather(&handleRows, 1, MPI_INT, sendcounts, 1, MPI_INT, comm);
+    endPhase(PHASE_READ);
+    for (i = 0, lineNums = 0; i < numprocs; i++) {
+        displs[i] = lineNums;
+        lineNums += sendcounts[i];
+    }
+    firstRow = displs[rank];
+    /* the file decides how many strands there are */
+    if (expected > 0 && expected != lineNums && rank == 0) {
+        printf("%s holds %d strands, not %d\n", filename, lineNums, expected);
+    }
+    if (lineNums < cluster) {
+        if (rank == 0) {
+            printf("%s holds %d strands, fewer than %d clusters\n", filename, lineNums, cluster);
+        }
+        MPI_Abort(comm, 1);
+    }
+    
+    /* the master seeds the medoids with k-means++ among candidate strands fetched from their owners */
+    beginPhase(PHASE_SEED);
+    StrandArena* medoids = seedMedoids(comm, strands, firstRow, lineNums, cluster);
+    endPhase(PHASE_SEED);
+    
+    int* categories = calloc(handleRows > 0 ? handleRows : 1, sizeof(int));
+    int* totalCategories = NULL;
+    kmeansTime = MPI_Wtime();
+    iterations = editKMeans(comm, strands, cluster, options, &medoids, categories, &cost);
+    
+    beginPhase(PHASE_GATHER);
+    if (options->labels != NULL) {
+        /* every process writes its own labels in place, nothing is gathered */
+        writeLabels(comm, options->labels, options->labelsFormat, categories, handleRows);
+    } else {
+        /* gather all the labels of all the strands on the master process */
+        totalCategories = malloc(sizeof(int) * lineNums);
+        MPI_Gatherv(categories, handleRows, MPI_INT, totalCategories, sendcounts, displs, MPI_INT, 0, comm);
+    }
+    endPhase(PHASE_GATHER);
+    kmeansTime = MPI_Wtime() - kmeansTime;
+    
+    /* every process holds the same medoids, the master keeps them */
+    if (rank == 0 && options->centroids != NULL) {
+        writeStrands(options->centroids, medoids);
+    }
+    if (rank == 0) {
+        printf("Total edit distance %g.\n", cost);
+        printf("K-Means converged after %d iterations.\n", iterations);
+        printf("K-Means took %lf seconds.\n", kmeansTime);
+    }
+    
+    free(sendcounts);
+    free(displs);
+    free(categories);
+    free(totalCategories);
+    freeStrandArena(strands);
+    freeStrandArena(medoids);
+}
 
-/* This is the threshold to end the calculation for DNA */
-#define DNA_DIFF_THRESHOLD 1
-/* This is the max difference of DNA */
-#define MAX_DIFF 2147483647
-/* This is the basic components fo the DNA sequence */
-char DNA_Components[4] = {'A','C','G','T'};
 
 int main(int argc,char** argv){
     
@@ -26,23 +176,123 @@ int main(int argc,char** argv){
     /* dimension of each point or DNA squence */
     int dimension;
     
+    /* the optional settings */
+    KMeansOptions options;
+    argc = parseOptions(argc, argv, &options);
+    
+    /* the header of a binary input file */
+    DatasetHeader header;
+    int binary = argc > 1 && readDatasetHeader(argv[1], &header);
+    
 	/* check the arguments if it is the DNA case */
-	if (argc < 5) {
-		printf("Usage: DNAKMeansMPI <input file name> <line Numbers> <cluster Numbers> <dimension>\n");
+	if (argc < (binary || options.variableLength ? 3 : 5)) {
+		printf("Usage: DNAKMeansMPI <input file name> <line Numbers> <cluster Numbers> <dimension> [options]\n");
+		printf("       DNAKMeansMPI <binary file name> <cluster Numbers> [options]\n");
+		printf("       DNAKMeansMPI <input file name> [line Numbers] <cluster Numbers> --variable-length 1 [options]\n");
+		printf("Options: --prune none|hamerly|elkan|auto\n");
+		printf("         --max-iterations N --minibatch B --final-pass 0|1\n");
+		printf("         --init random|kmeans++|kmeans|| --threads T\n");
+		printf("         --stream CHUNK --spill PREFIX --pipeline BLOCKS\n");
+		printf("         --timing FILE --labels FILE --labels-format text|binary --centroids FILE\n");
+		printf("         --rebalance N --delta 0|1 --min-changed ROWS --owned-centroids 0|1 --restarts R\n");
+		printf("         --sweep LIST of cluster numbers, e.g. 2:16 or 4,8,16\n");
+		printf("         --variable-length 0|1 --band W\n");
+		printf("         --shared-memory 0|1\n");
 		exit(-1);
 	}
+    if (options.stream > 0 && !binary) {
+        printf("--stream needs a binary data set, see csv2bin\n");
+        exit(-1);
+    }
+    if (options.stream > 0 && options.labels != NULL && options.labelsFormat != LABELS_BINARY) {
+        printf("--stream writes its labels chunk by chunk, use --labels-format binary\n");
+        exit(-1);
+    }
+    if (options.sweepNums > 0 && (options.stream > 0 || options.restarts > 1)) {
+        printf("--sweep needs the rows in memory and all the processes, not --stream or --restarts\n");
+        exit(-1);
+    }
+    if (options.sweepNums > 0 && !options.finalPass) {
+        printf("--sweep needs a label for every row, not --final-pass 0\n");
+        exit(-1);
+    }
+    if (options.index != INDEX_NONE) {
+        printf("--index kdtree is for points only, see TwoDKMeansMPI\n");
+        exit(-1);
+    }
+    if (options.precision != PRECISION_DOUBLE) {
+        printf("--precision single is for points only, see TwoDKMeansMPI\n");
+        exit(-1);
+    }
+    if (options.variableLength && (binary || options.stream > 0 || options.restarts > 1 || options.sweepNums > 0)) {
+        printf("--variable-length needs a text file, not --stream, --restarts or --sweep\n");
+        exit(-1);
+    }
+    if (options.variableLength &&
+        (options.prune != PRUNE_NONE || options.miniBatch > 0 || options.delta || options.ownedCentroids ||
+         options.pipeline > 1 || options.rebalance > 0 || options.init == INIT_RANDOM)) {
+        printf("--variable-length seeds with k-means++ and assigns every strand to every medoid, not --prune,\n");
+        printf("--minibatch, --delta, --owned-centroids, --pipeline, --rebalance or --init random\n");
+        exit(-1);
+    }
+    if (options.band > 0 && !options.variableLength) {
+        printf("--band needs --variable-length 1\n");
+        exit(-1);
+    }
+    if (options.sharedMemory && (!binary || options.stream > 0 || options.restarts > 1 || options.rebalance > 0)) {
+        printf("--shared-memory needs a binary data set, not --stream, --restarts or --rebalance\n");
+        exit(-1);
+    }
+    if (options.stream > 0 && options.restarts > 1) {
+        printf("--restarts needs the rows in memory, not --stream\n");
+        exit(-1);
+    }
+    if (options.restarts > 1 && !options.finalPass) {
+        printf("--restarts compares the cost of every row, not --final-pass 0\n");
+        exit(-1);
+    }
     
     /* file name */
 	filename = argv[1];
     
-	/* how many points */
-	lineNums = atoi(argv[2]);
-    
-	/* how many clusters */
-	cluster = atoi(argv[3]);
-    
-    /* decide the dimension */
-    dimension = atoi(argv[4]);
+    if (binary) {
+        /* the header tells how many strands there are and how long they are */
+        if (header.version != DATASET_VERSION) {
+            printf("%s is a version %d data set, this build reads version %d, see csv2bin\n",
+                   filename, header.version, DATASET_VERSION);
+            exit(-1);
+        }
+        if (header.elementType != DATASET_DNA2BIT) {
+            printf("%s is a %s data set, not DNA strands\n", filename, datasetTypeName(header.elementType));
+            exit(-1);
+        }
+        /* the rows are counted in int everywhere after this */
+        if (header.rows > INT_MAX) {
+            printf("%s has %lld rows, more than the %d this build handles\n",
+                   filename, (long long)header.rows, INT_MAX);
+            exit(-1);
+        }
+        lineNums = (int)header.rows;
+        cluster = atoi(argv[2]);
+        dimension = header.dimension;
+    } else if (options.variableLength) {
+        /* the strands have no common length and the reader counts them, the line number is only checked */
+        lineNums = argc > 3 ? atoi(argv[2]) : 0;
+        cluster = atoi(argv[argc > 3 ? 3 : 2]);
+        dimension = 0;
+    } else {
+        /* how many points */
+        lineNums = atoi(argv[2]);
+        
+        /* how many clusters */
+        cluster = atoi(argv[3]);
+        
+        /* decide the dimension */
+        dimension = atoi(argv[4]);
+    }
+    /* the sweep resolves the options for each of its cluster numbers */
+    KMeansOptions unresolved = options;
+    resolveOptions(&options, cluster);
     
 
     
@@ -53,92 +303,183 @@ int main(int argc,char** argv){
     int numprocs, rank;
     
     /* Initilize of MPI*/
-    MPI_Init(&argc,&argv);
+    /* only the main thread of every process calls MPI, see threadpool.h */
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    if (options.timing != NULL) {
+        startTiming();
+    }
     /*declare a variable to hold the time returned*/
     double startwtime, endwtime;
     /*get the time just before work to be timed*/
     startwtime = MPI_Wtime();
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 	MPI_Comm_size(MPI_COMM_WORLD, &numprocs);
+    if (provided < MPI_THREAD_FUNNELED && options.threads > 1) {
+        /* without funneled support the MPI library may not tolerate the pool threads at all */
+        if (rank == 0) {
+            printf("This MPI only provides MPI_THREAD_SINGLE, --threads %d falls back to 1\n", options.threads);
+        }
+        options.threads = 1;
+    }
+    if (options.restarts > numprocs) {
+        if (rank == 0) {
+            printf("--restarts %d needs at least %d processes\n", options.restarts, options.restarts);
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
     
+    /* Step 3 to 5 for strands of any length instead, the dimension is not used */
+    if (options.variableLength) {
+        clusterStrands(MPI_COMM_WORLD, filename, lineNums, cluster, &options);
+        endwtime = MPI_Wtime();
+        printf("Timing span of this job is %lf seconds.\n", endwtime - startwtime);
+        writeTimingReport(MPI_COMM_WORLD, options.timing);
+        MPI_Finalize();
+        return 0;
+    }
     
     
     
-    /* Step 3: Build the buffers */
     
-    /* the total contents to be handled for DNA strands */
-    char* DNASource;
+    /* Step 3: Read the contents */
     
-    /* the contents for each processor of DNA strands */
-    char* RecvbufDNA;
+    /* the packed contents for each processor of DNA strands, 2 bits per base */
+    uint64_t* RecvbufDNA;
     
-    /* DNA centroids */
-    char* DNACentroids;
+    /* packed DNA centroids */
+    uint64_t* packedCentroids;
     
-    /* the working line numbers of each process */
+    /* the number of packed words of each strand */
+    int words = packedWords(dimension);
     
-    int handleNumbers;
-    
-    /* for example: 501 lines and 10 processor
-     * it need 51 lines per processor, but if it just has 500 lines,
-     * it need 50 lines per processor.
-     */
-    if (lineNums % numprocs > 0) {
-        handleNumbers = (lineNums / numprocs  + 1 ) * dimension;
+    /* the working line numbers of each process */
+    int handleRows;
+    
+    /* the chunks of a streamed binary file, which is never loaded at once */
+    RowStream* stream = NULL;
+    
+    /* with --shared-memory the window the rows of this node live in, see readSharedPartition */
+    MPI_Win window = MPI_WIN_NULL;
+    
+    beginPhase(PHASE_READ);
+    /* every process maps its rows of a binary file, the first process of every node those of
+     * the node with --shared-memory, or reads and packs its own share of a text file with MPI-IO */
+    if (options.stream > 0) {
+        int firstRow;
+        stream = openRowStream(MPI_COMM_WORLD, filename, &header, options.stream);
+        handleRows = streamRows(stream, &firstRow);
+        RecvbufDNA = NULL;
+    } else if (options.sharedMemory) {
+        RecvbufDNA = readSharedPartition(MPI_COMM_WORLD, filename, &header, &handleRows, &window);
+    } else if (binary) {
+        RecvbufDNA = readBinaryPartition(MPI_COMM_WORLD, filename, &header, &handleRows);
     } else {
-        handleNumbers = lineNums / numprocs * dimension;
+        RecvbufDNA = readDNAPartition(MPI_COMM_WORLD, filename, dimension, &handleRows);
     }
-    
-    DNASource = malloc(sizeof(char) * dimension * lineNums);
-    RecvbufDNA = malloc(sizeof(char) * handleNumbers);
-    DNACentroids = malloc(sizeof(char) * cluster * dimension);
-    
-    
-    
-    
-    /* Step 4: Read the contents, generating centroids and calculating the cursor */
-    
-    /* the file to be handled */
-    FILE* fp;
-    
-    /* if it's master, read the data source and genterate centroids */
-	if (rank == 0) {
-		fp = fopen(filename, "r");
-		if(fp == NULL) {
-			printf("Cannot open file %s\n", filename);
-			exit(-1);
-		}
-		
-		readDNAContents(fp, DNASource, dimension);
-        generateDNACentroids(DNACentroids, DNASource, lineNums, dimension, cluster);
-        
-		fclose(fp);
-	}
+    packedCentroids = malloc(sizeof(uint64_t) * cluster * words);
     
     /* compute the handling lines and start index for each processes */
 	int* sendcounts = malloc(sizeof(int)*numprocs);
 	int* displs = malloc(sizeof(int)*numprocs);
-	int processIndex;
-    /* the previous n - 1 process must be full */
-	for(processIndex = 0;processIndex < numprocs - 1;processIndex++) {
-		sendcounts[processIndex] = handleNumbers;
-	}
-    /* tha last process's handling lines */
-	sendcounts[numprocs - 1] = lineNums * dimension - handleNumbers * (numprocs - 1);
-    
+    MPI_Allgather(&handleRows, 1, MPI_INT, sendcounts, 1, MPI_INT, MPI_COMM_WORLD);
+    
+    /* the processes the k-means runs on: all of them, or with --restarts the group of this
+     * process, which gets a copy of all the rows and its own seed */
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int restart = 0;
+    if (options.restarts > 1) {
+        comm = splitRestarts(MPI_COMM_WORLD, options.restarts, &restart);
+        RecvbufDNA = replicateRows(MPI_COMM_WORLD, comm, RecvbufDNA, &handleRows, sizeof(uint64_t) * words);
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &numprocs);
+        MPI_Allgather(&handleRows, 1, MPI_INT, sendcounts, 1, MPI_INT, comm);
+        srand(1 + restart);
+    }
+    endPhase(PHASE_READ);
     
     /* Compute the beginning index of line number for each process */
 	int offset = 0;
-    /* the two variable are used in the loop */
-    int i,j;
+    /* the variable used in the loop */
+    int i;
 	for(i = 0;i < numprocs;i++) {
 		displs[i] = offset;
 		offset += sendcounts[i];
 	}
+    /* the file decides how many strands there are */
+    if (offset != lineNums && rank == 0) {
+        printf("%s holds %d strands, not %d\n", filename, offset, lineNums);
+    }
+    lineNums = offset;
+    
+    /* Step 4 and 5 for every k of a sweep instead, on the strands loaded above */
+    if (options.sweepNums > 0) {
+        sweepClusters(MPI_COMM_WORLD, &RecvbufDNA, &handleRows, displs[rank], lineNums, dimension, &unresolved);
+        free(sendcounts);
+        free(displs);
+        freePartition(RecvbufDNA, &window);
+        free(packedCentroids);
+        writeTimingReport(MPI_COMM_WORLD, options.timing);
+        MPI_Finalize();
+        return 0;
+    }
     
-	/* scatter the data and broadcast the center*/
-	MPI_Scatterv (DNASource,sendcounts,displs,MPI_CHAR,RecvbufDNA,handleNumbers,MPI_CHAR,0,MPI_COMM_WORLD);
-    MPI_Bcast (DNACentroids,cluster * dimension,MPI_CHAR,0,MPI_COMM_WORLD);
+    
+    
+    
+    /* Step 4: Generating centroids */
+    
+    beginPhase(PHASE_SEED);
+    /* k-means|| needs the strands in memory, a streamed run seeds with k-means++ instead */
+    if (options.init == INIT_KMEANSPARALLEL && stream == NULL) {
+        /* every process samples its own strands and all of them end up with the centroids */
+        kmeansParallel(comm, RecvbufDNA, handleRows, displs[rank], lineNums, sizeof(uint64_t) * words,
+                       words, dnaSeedDistance, cluster, packedCentroids);
+    } else {
+        /* the master of the group picks the centroids among candidate strands fetched from their owners */
+        int candidateNums;
+        int* candidates = seedCandidates(lineNums, cluster, &candidateNums);
+        uint64_t* candidateRows = malloc(sizeof(uint64_t) * candidateNums * words);
+        MPI_Bcast(candidates, candidateNums, MPI_INT, 0, comm);
+        if (stream != NULL) {
+            /* the master reads the candidates straight from the file */
+            if (rank == 0) {
+                readDatasetRows(filename, &header, candidates, candidateNums, candidateRows);
+            }
+        } else {
+            fetchRows(comm, 0, candidates, candidateNums, RecvbufDNA, displs[rank], handleRows,
+                      sizeof(uint64_t) * words, candidateRows);
+        }
+        if (rank == 0 && options.init != INIT_RANDOM) {
+            kmeansPlusPlus(candidateRows, NULL, candidateNums, sizeof(uint64_t) * words, words,
+                           dnaSeedDistance, cluster, packedCentroids);
+        } else if (rank == 0) {
+            /* the seeding compares characters, so the candidates are unpacked for it */
+            char* candidateStrands = malloc(sizeof(char) * candidateNums * dimension);
+            char* DNACentroids = malloc(sizeof(char) * cluster * dimension);
+            for (i = 0; i < candidateNums; i++) {
+                unpackDNA(candidateRows + (size_t)i * words, candidateStrands + (size_t)i * dimension, dimension);
+            }
+            if (generateDNACentroids(DNACentroids, candidateStrands, candidateNums, dimension, cluster)) {
+                for (i = 0; i < cluster; i++) {
+                    packDNA(DNACentroids + i * dimension, packedCentroids + i * words, dimension);
+                }
+            } else {
+                /* fewer distinct strands than clusters, k-means++ repeats some of them */
+                printf("--init random found no %d different enough strands, seeding with k-means++\n", cluster);
+                kmeansPlusPlus(candidateRows, NULL, candidateNums, sizeof(uint64_t) * words, words,
+                               dnaSeedDistance, cluster, packedCentroids);
+            }
+            free(candidateStrands);
+            free(DNACentroids);
+        }
+        free(candidates);
+        free(candidateRows);
+        
+        /* broadcast the center*/
+        MPI_Bcast (packedCentroids,cluster * words,MPI_UINT64_T,0,comm);
+    }
+    endPhase(PHASE_SEED);
     
     
     
@@ -146,124 +487,60 @@ int main(int argc,char** argv){
     /* Step5: K-Means Calculating */
     
     /* categorized all the points or DNA strands into different clusters for each processor*/
-    int handleRows = sendcounts[rank] / dimension;
-    int* categories = malloc(sizeof(int) * handleRows);
+    int* categories = NULL;
     /* all the labels of all the points on the master process */
-	int* totalCategories = malloc(sizeof(int)*lineNums);
-    
-    do {
-            /* termination flag */
-			int flag = 0;
-            
-            /* Example: Cluster = 2, Dimension = 4 */
-            /* A             C              G               T          */
-            /*  0| 4| 8|12   1 | 5| 9|13    2| 6|10|14      3| 7|11|15 */
-            /* 16|20|24|28   17|21|25|29   18|22|26|30     19|23|27|31 */
-             
-			int* newGeneratedContents = malloc(sizeof(int) * cluster * dimension * 4);
-			memset(newGeneratedContents, 0, sizeof(int) * cluster * dimension * 4);
-			int* distributedContents = malloc(sizeof(int) * cluster * dimension * 4);
-            
-			/* the centroids for every cluster computed */
-			char* distributedCentroids = malloc(sizeof(char) * cluster * dimension);
-            
-			/* Calculate each points distances to centroids and categorize it */
-			for(i = 0; i < handleRows; i++) {
-				int category = -1;
-				int DNAmaxDiff = MAX_DIFF;
-				for(j = 0; j < cluster;j++) {
-					int calculatedDistance = DNADistance(DNACentroids+j*dimension, RecvbufDNA+i*dimension, dimension);
-					if (calculatedDistance < DNAmaxDiff) {
-						DNAmaxDiff = calculatedDistance;
-						category = j;
-					}
-				}
-                
-				/* Work for each Line's character and update the array's value */
-				for(j = 0; j < dimension; j++) {
-					switch(RecvbufDNA[i * dimension + j]) {
-						case 'A':
-							newGeneratedContents[4 * dimension * category + 4 * j + 0]++;
-							break;
-						case 'C':
-							newGeneratedContents[4 * dimension * category + 4 * j + 1]++;
-							break;
-						case 'G':
-							newGeneratedContents[4 * dimension * category + 4 * j + 2]++;
-							break;
-						case 'T':
-							newGeneratedContents[4 * dimension * category + 4 * j + 3]++;
-							break;
-						default:
-							break;
-					}
-				}
-                
-				/* update the point's category */
-				categories[i] = category;
-			}
-			
-			/* reduce step - the character counts in every position of each point on the master node */
-			MPI_Reduce(newGeneratedContents, distributedContents, cluster * 4 * dimension, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-            
-            
-			
-			/* on the master node, compute the new centroid for each cluster */
-			if(rank == 0) {
-                /* i means cluster */
-				for (i = 0; i < cluster; i++) {
-					/* j means each character of one sequence */
-					for (j = 0; j < dimension; j++) {
-						int aValue = distributedContents[i * dimension * 4 + 4 * j + 0];
-                        int cValue = distributedContents[i * dimension * 4 + 4 * j + 1];
-                        int gValue = distributedContents[i * dimension * 4 + 4 * j + 2];
-                        int tValue = distributedContents[i * dimension * 4 + 4 * j + 3];
-                        int resultValue = max(aValue,max(cValue,max(gValue,tValue)));
-                        if (resultValue == aValue) {
-                            distributedCentroids[i * dimension + j] = DNA_Components[0];
-                        } else if(resultValue == cValue) {
-                            distributedCentroids[i * dimension + j] = DNA_Components[1];
-                        } else if (resultValue == gValue) {
-                            distributedCentroids[i * dimension + j] = DNA_Components[2];
-                        } else {
-                            distributedCentroids[i * dimension + j] = DNA_Components[3];
-                        }
-					}
-				}
-				/* initialize the diffrenciation of centroids between orginal and new genereated */
-				int sumDistance = 0;
-				/* iterate each cluster centroid and update the difference of centroids */
-				for(i =0;i<cluster;i++) {
-					sumDistance += DNADistance(distributedCentroids + dimension * i,DNACentroids + dimension * i,dimension);
-				}
-				/* see if it is time to terminate */
-				if(sumDistance <= DNA_DIFF_THRESHOLD) {
-                    flag = 1;
+	int* totalCategories = NULL;
+    
+    /* the iterations run by the k-means engine and how long they took */
+    int iterations;
+    /* the group whose result is kept */
+    int best = 0;
+    double kmeansTime = MPI_Wtime();
+    
+    if (stream != NULL) {
+        /* the labels of every process go to their place in the label file, or spill to a file of its own */
+        MPI_File labels = options.labels != NULL ? openLabelFile(comm, options.labels, displs[rank])
+                                                 : openSpillFile(options.spill, rank);
+        iterations = dnaKMeansStream(comm, stream, dimension, cluster, &options, packedCentroids, labels);
+        MPI_File_close(&labels);
+        closeRowStream(stream);
+    } else {
+        categories = malloc(sizeof(int) * handleRows);
+        iterations = dnaKMeans(comm, &RecvbufDNA, &handleRows, dimension, cluster, &options, packedCentroids, &categories);
+        
+        if (options.restarts > 1) {
+            /* only the labels and centroids of the cheapest run are kept */
+            double cost = dnaCost(RecvbufDNA, handleRows, dimension, packedCentroids, categories);
+            best = bestRestart(MPI_COMM_WORLD, comm, restart, cost, &cost);
+            if (rank == 0) {
+                printf("Restart %d: total Hamming distance %g after %d iterations.\n", restart, cost, iterations);
+            }
+        }
+        
+        beginPhase(PHASE_GATHER);
+        if (restart == best && options.labels != NULL) {
+            /* every process writes its own labels in place, nothing is gathered */
+            writeLabels(comm, options.labels, options.labelsFormat, categories, handleRows);
+        } else if (restart == best) {
+            /* gather all the labels of all the points on the master process */
+            totalCategories = malloc(sizeof(int)*lineNums);
+            if (options.rebalance > 0) {
+                /* the rows may have moved between the processes */
+                MPI_Allgather(&handleRows, 1, MPI_INT, sendcounts, 1, MPI_INT, comm);
+                for (i = 1; i < numprocs; i++) {
+                    displs[i] = displs[i - 1] + sendcounts[i - 1];
                 }
-				free(DNACentroids);
-				DNACentroids = distributedCentroids;
-			}
-            
-			/* broadcast the terminate flag */
-			MPI_Bcast (&flag,1,MPI_INT,0,MPI_COMM_WORLD);
-			free(newGeneratedContents);
-			free(distributedContents);
-			if(flag) {
-                break;
             }
-			
-            /* broadcast the new centroids */
-			MPI_Bcast (DNACentroids,cluster * dimension,MPI_CHAR,0,MPI_COMM_WORLD);
-    }while (1);
+            MPI_Gatherv (categories,handleRows,MPI_INT,totalCategories,sendcounts,displs,MPI_INT,0,comm);
+        }
+        endPhase(PHASE_GATHER);
+    }
+    kmeansTime = MPI_Wtime() - kmeansTime;
     
-    /* gather all the labels of all the points on the master process */
-	int displacement = 0;
-	for(i = 0;i < numprocs;i++) {
-		sendcounts[i] /= dimension;
-		displs[i] = displacement;
-		displacement += sendcounts[i];
-	}
-	MPI_Gatherv (categories,handleRows,MPI_INT,totalCategories,sendcounts,displs,MPI_INT,0,MPI_COMM_WORLD);
+    /* every process holds the same centroids, the master keeps them */
+    if (rank == 0 && restart == best && options.centroids != NULL) {
+        writeDNACentroids(options.centroids, packedCentroids, cluster, dimension);
+    }
 	
 	
     
@@ -273,12 +550,23 @@ int main(int argc,char** argv){
 	free(displs);
 	free(categories);
 	free(totalCategories);
-    free(DNASource);
-    free(RecvbufDNA);
-    free(DNACentroids);
+    freePartition(RecvbufDNA, &window);
+    free(packedCentroids);
     
     /*get the time just after work is done and take the difference */
     endwtime = MPI_Wtime();
+    if (rank == 0 && restart == best) {
+        if (options.restarts > 1) {
+            printf("Kept restart %d of %d.\n", best, options.restarts);
+        }
+        printf("K-Means converged after %d iterations.\n", iterations);
+        printf("K-Means took %lf seconds.\n", kmeansTime);
+    }
     printf("Timing span of this job is %lf seconds.\n",endwtime - startwtime);
+    /* the phase times of every process, see timing.h */
+    writeTimingReport(MPI_COMM_WORLD, options.timing);
+    if (comm != MPI_COMM_WORLD) {
+        MPI_Comm_free(&comm);
+    }
 	MPI_Finalize();
 }
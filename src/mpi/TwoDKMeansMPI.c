@@ -1,12 +1,78 @@
 #include "mpi.h"
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include "Util.h"
+#include "dataio.h"
+#include "vectorkmeans.h"
+#include "seeding.h"
+#include "timing.h"
+#include "restarts.h"
+
+
+/*
+ * --sweep: k-means for every k of options->sweep on the points loaded once.
+ * The master seeds with k-means++ among one set of candidate points, a k
+ * at least as large as the one before keeps its centroids and only draws
+ * the new ones. Prints the cost, the mean simplified silhouette, the
+ * iterations and the time of each k.
+ */
+static void sweepClusters(MPI_Comm comm, double** rows, int* handleRows, int firstRow, int lineNums, int dimension,
+                          const KMeansOptions* options) {
+    int rank;
+    int largest = 1;
+    int previous = 0;
+    int candidateNums;
+    int* candidates;
+    int s;
+    int rowBytes = sizeof(double) * dimension;
+    
+    MPI_Comm_rank(comm, &rank);
+    for (s = 0; s < options->sweepNums; s++) {
+        largest = max(largest, options->sweep[s]);
+    }
+    candidates = seedCandidates(lineNums, largest, &candidateNums);
+    double* candidateRows = malloc((size_t)candidateNums * rowBytes);
+    double* centroids = malloc((size_t)largest * rowBytes);
+    int* categories = malloc(sizeof(int) * max(*handleRows, 1));
+    MPI_Bcast(candidates, candidateNums, MPI_INT, 0, comm);
+    fetchRows(comm, 0, candidates, candidateNums, *rows, firstRow, *handleRows, rowBytes, candidateRows);
+    
+    if (rank == 0) {
+        printf("%8s %16s %11s %11s %10s\n", "k", "sum of squares", "silhouette", "iterations", "seconds");
+    }
+    for (s = 0; s < options->sweepNums; s++) {
+        int cluster = options->sweep[s];
+        KMeansOptions resolved = *options;
+        double local[2], total[2];
+        double seconds = MPI_Wtime();
+        int iterations;
+        
+        resolveOptions(&resolved, cluster);
+        if (rank == 0 && previous > 0 && previous <= cluster) {
+            extendSeeds(candidateRows, NULL, candidateNums, rowBytes, dimension, vectorSeedDistance, previous, cluster, centroids);
+        } else if (rank == 0) {
+            kmeansPlusPlus(candidateRows, NULL, candidateNums, rowBytes, dimension, vectorSeedDistance, cluster, centroids);
+        }
+        MPI_Bcast(centroids, cluster * dimension, MPI_DOUBLE, 0, comm);
+        iterations = vectorKMeans(comm, rows, handleRows, dimension, cluster, &resolved, centroids, &categories);
+        
+        local[0] = vectorCost(*rows, *handleRows, dimension, centroids, categories);
+        local[1] = vectorSilhouette(*rows, *handleRows, dimension, centroids, cluster, categories);
+        MPI_Reduce(local, total, 2, MPI_DOUBLE, MPI_SUM, 0, comm);
+        seconds = MPI_Wtime() - seconds;
+        if (rank == 0) {
+            printf("%8d %16.9g %11.6f %11d %10.4f\n", cluster, total[0], total[1] / lineNums, iterations, seconds);
+        }
+        previous = cluster;
+    }
+    
+    free(candidates);
+    free(candidateRows);
+    free(centroids);
+    free(categories);
+}
 
-/* This is the threshold to end the calculation for 2D */
-#define TwoD_DIFF_THRESHOLD 0.000000001
-/* This is the max difference of 2D */
-#define MAX_DIFF 2147483647
 
 int main(int argc,char** argv){
     
@@ -24,23 +90,114 @@ int main(int argc,char** argv){
     /* dimension of each point or DNA squence */
     int dimension;
     
+    /* the optional settings */
+    KMeansOptions options;
+    argc = parseOptions(argc, argv, &options);
+    
+    /* the header of a binary input file */
+    DatasetHeader header;
+    int binary = argc > 1 && readDatasetHeader(argv[1], &header);
+    
     /* check the arguments */
-	if (argc < 4) {
-		printf("Usage: TwoDKMeansMPI <input file name> <line Numbers> <cluster Numbers> \n");
+	if (argc < (binary ? 3 : 4)) {
+		printf("Usage: TwoDKMeansMPI <input file name> <line Numbers> <cluster Numbers> [dimension] [options]\n");
+		printf("       TwoDKMeansMPI <binary file name> <cluster Numbers> [options]\n");
+		printf("Options: --prune none|hamerly|elkan|auto\n");
+		printf("         --max-iterations N --minibatch B --final-pass 0|1\n");
+		printf("         --init random|kmeans++|kmeans|| --threads T\n");
+		printf("         --index none|kdtree --stream CHUNK --spill PREFIX --pipeline BLOCKS\n");
+		printf("         --timing FILE --labels FILE --labels-format text|binary --centroids FILE\n");
+		printf("         --rebalance N --delta 0|1 --min-changed ROWS --restarts R\n");
+		printf("         --sweep LIST of cluster numbers, e.g. 2:16 or 4,8,16\n");
+		printf("         --precision double|single\n");
+		printf("         --shared-memory 0|1\n");
 		exit(-1);
 	}
+    if (options.ownedCentroids) {
+        printf("--owned-centroids is for DNA strands, see DNAKMeansMPI\n");
+        exit(-1);
+    }
+    if (options.variableLength || options.band > 0) {
+        printf("--variable-length and --band are for DNA strands, see DNAKMeansMPI\n");
+        exit(-1);
+    }
+    if (options.stream > 0 && !binary) {
+        printf("--stream needs a binary data set, see csv2bin\n");
+        exit(-1);
+    }
+    if (options.stream > 0 && options.labels != NULL && options.labelsFormat != LABELS_BINARY) {
+        printf("--stream writes its labels chunk by chunk, use --labels-format binary\n");
+        exit(-1);
+    }
+    if (options.sweepNums > 0 && (options.stream > 0 || options.restarts > 1)) {
+        printf("--sweep needs the rows in memory and all the processes, not --stream or --restarts\n");
+        exit(-1);
+    }
+    if (options.sweepNums > 0 && !options.finalPass) {
+        printf("--sweep needs a label for every row, not --final-pass 0\n");
+        exit(-1);
+    }
+    if (options.precision == PRECISION_SINGLE && (options.stream > 0 || options.sweepNums > 0)) {
+        printf("--precision single needs the rows in memory for one cluster number, not --stream or --sweep\n");
+        exit(-1);
+    }
+    if (options.precision == PRECISION_SINGLE &&
+        (options.prune != PRUNE_NONE || options.index != INDEX_NONE || options.pipeline > 1 || options.delta ||
+         options.rebalance > 0 || options.miniBatch > 0)) {
+        printf("--precision single runs the full assignment only,\n");
+        printf("not --prune, --index, --pipeline, --delta, --rebalance or --minibatch\n");
+        exit(-1);
+    }
+    if (options.sharedMemory && (!binary || options.stream > 0 || options.restarts > 1 || options.rebalance > 0 ||
+                                 options.precision == PRECISION_SINGLE)) {
+        printf("--shared-memory needs a binary data set, not --stream, --restarts, --rebalance or --precision single\n");
+        exit(-1);
+    }
+    if (options.stream > 0 && options.restarts > 1) {
+        printf("--restarts needs the rows in memory, not --stream\n");
+        exit(-1);
+    }
+    if (options.restarts > 1 && !options.finalPass) {
+        printf("--restarts compares the cost of every row, not --final-pass 0\n");
+        exit(-1);
+    }
     
     /* file name */
 	filename = argv[1];
     
-	/* how many points */
-	lineNums = atoi(argv[2]);
-    
-	/* how many clusters */
-	cluster = atoi(argv[3]);
-    
-    /* 2D dimension */
-    dimension = 2;
+    if (binary) {
+        /* the header tells how many points there are and their dimension */
+        if (header.version != DATASET_VERSION) {
+            printf("%s is a version %d data set, this build reads version %d, see csv2bin\n",
+                   filename, header.version, DATASET_VERSION);
+            exit(-1);
+        }
+        if (header.elementType != DATASET_FLOAT64) {
+            printf("%s is a %s data set, not points\n", filename, datasetTypeName(header.elementType));
+            exit(-1);
+        }
+        /* the rows are counted in int everywhere after this */
+        if (header.rows > INT_MAX) {
+            printf("%s has %lld rows, more than the %d this build handles\n",
+                   filename, (long long)header.rows, INT_MAX);
+            exit(-1);
+        }
+        lineNums = (int)header.rows;
+        cluster = atoi(argv[2]);
+        dimension = header.dimension;
+    } else {
+        /* how many points */
+        lineNums = atoi(argv[2]);
+        
+        /* how many clusters */
+        cluster = atoi(argv[3]);
+        
+        /* 2D unless the dimension is given */
+        dimension = argc > 4 ? atoi(argv[4]) : 2;
+    }
+    /* the sweep resolves the options for each of its cluster numbers */
+    KMeansOptions unresolved = options;
+    resolveOptions(&options, cluster);
     
     
     
@@ -50,102 +207,185 @@ int main(int argc,char** argv){
     int numprocs, rank;
     
     /* Initilize of MPI*/
-    MPI_Init(&argc,&argv);
+    /* only the main thread of every process calls MPI, see threadpool.h */
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    if (options.timing != NULL) {
+        startTiming();
+    }
     /*declare a variable to hold the time returned*/
     double startwtime, endwtime;
     /*get the time just before work to be timed*/
     startwtime = MPI_Wtime();
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 	MPI_Comm_size(MPI_COMM_WORLD, &numprocs);
+    if (provided < MPI_THREAD_FUNNELED && options.threads > 1) {
+        /* without funneled support the MPI library may not tolerate the pool threads at all */
+        if (rank == 0) {
+            printf("This MPI only provides MPI_THREAD_SINGLE, --threads %d falls back to 1\n", options.threads);
+        }
+        options.threads = 1;
+    }
+    if (options.restarts > numprocs) {
+        if (rank == 0) {
+            printf("--restarts %d needs at least %d processes\n", options.restarts, options.restarts);
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
     
     
     
     
-    /* Step 3: Build the buffers */
-    
-    /* the total contents to be handled for 2D points */
-    double* TwoDSource;
+    /* Step 3: Read the contents */
     
     /* the contents for each processor of 2D points */
     double* Recvbuf2D;
     
+    /* the same points narrowed to floats with --precision single, Recvbuf2D is then NULL */
+    float* SingleRecvbuf = NULL;
+    
     /* 2D centroids */
     double* TwoDCentroids;
     
     /* the working point numbers of each process */
-    
-    int handleNumbers;
-    
-    /* for example: 501 lines and 10 processor
-     * it need 51 lines per processor, but if it just has 500 lines,
-     * it need 50 lines per processor.
-     */
-    if (lineNums % numprocs > 0) {
-        handleNumbers = (lineNums / numprocs  + 1 ) * dimension;
+    int handleRows;
+    
+    /* the chunks of a streamed binary file, which is never loaded at once */
+    RowStream* stream = NULL;
+    
+    /* with --shared-memory the window the rows of this node live in, see readSharedPartition */
+    MPI_Win window = MPI_WIN_NULL;
+    
+    beginPhase(PHASE_READ);
+    /* every process maps its rows of a binary file, the first process of every node those of
+     * the node with --shared-memory, or reads its own share of a text file with MPI-IO */
+    if (options.stream > 0) {
+        int firstRow;
+        stream = openRowStream(MPI_COMM_WORLD, filename, &header, options.stream);
+        handleRows = streamRows(stream, &firstRow);
+        Recvbuf2D = NULL;
+    } else if (options.sharedMemory) {
+        Recvbuf2D = readSharedPartition(MPI_COMM_WORLD, filename, &header, &handleRows, &window);
+    } else if (binary) {
+        Recvbuf2D = readBinaryPartition(MPI_COMM_WORLD, filename, &header, &handleRows);
     } else {
-        handleNumbers = lineNums / numprocs * dimension;
+        Recvbuf2D = read2DPartition(MPI_COMM_WORLD, filename, dimension, &handleRows);
+    }
+    if (options.precision == PRECISION_SINGLE) {
+        SingleRecvbuf = narrowRows(Recvbuf2D, (size_t)handleRows * dimension);
+        Recvbuf2D = NULL;
     }
-//    printf("It needs to handle : %d\n", handleNumbers);
-    TwoDSource = malloc(sizeof(double) * dimension * lineNums);
-    Recvbuf2D = malloc(sizeof(double) * handleNumbers);
     TwoDCentroids = malloc(sizeof(double) * cluster * dimension);
-//    
-//    printf("cluster : %d\n", cluster);
-//    printf("dimension : %d\n", dimension);
-    
-    
-    /* Step 4: Read the contents, generating centroids and calculating the cursor */
-    
-    /* the file to be handled */
-    FILE* fp;
-    
-    /* if it's master, read the data source and genterate centroids */
-	if (rank == 0) {
-		fp = fopen(filename, "r");
-		if(fp == NULL) {
-			printf("Cannot open file %s\n", filename);
-			exit(-1);
-		}
-		
-		read2DContents(fp, TwoDSource);
-        generate2DCentroids(TwoDCentroids, TwoDSource, lineNums, dimension, cluster);
-        fclose(fp);
-	}
-    
-    // int k;
-    // for(k = 0; k < sizeof(TwoDCentroids) / sizeof(TwoDCentroids[0]); k++) {
-    //     printf("%f\n", TwoDCentroids[k]);
-    // }
-    
     
     /* compute the handling lines and start index for each processes */
 	int* sendcounts = malloc(sizeof(int)*numprocs);
-    
 	int* displs = malloc(sizeof(int)*numprocs);
-	int processIndex;
-    /* the previous n - 1 process must be full */
-	for(processIndex = 0;processIndex < numprocs - 1;processIndex++) {
-		sendcounts[processIndex] = handleNumbers;
-	}
-    /* tha last process's handling lines */
-	sendcounts[numprocs - 1] = lineNums * dimension - handleNumbers * (numprocs - 1);
-    
-    
-    
-    
+    MPI_Allgather(&handleRows, 1, MPI_INT, sendcounts, 1, MPI_INT, MPI_COMM_WORLD);
+    
+    /* the processes the k-means runs on: all of them, or with --restarts the group of this
+     * process, which gets a copy of all the rows and its own seed */
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int restart = 0;
+    if (options.restarts > 1) {
+        comm = splitRestarts(MPI_COMM_WORLD, options.restarts, &restart);
+        if (SingleRecvbuf != NULL) {
+            SingleRecvbuf = replicateRows(MPI_COMM_WORLD, comm, SingleRecvbuf, &handleRows, sizeof(float) * dimension);
+        } else {
+            Recvbuf2D = replicateRows(MPI_COMM_WORLD, comm, Recvbuf2D, &handleRows, sizeof(double) * dimension);
+        }
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &numprocs);
+        MPI_Allgather(&handleRows, 1, MPI_INT, sendcounts, 1, MPI_INT, comm);
+        srand(1 + restart);
+    }
+    endPhase(PHASE_READ);
     
     /* Compute the beginning index of line number for each process */
 	int offset = 0;
-    /* the two variable are used in the loop */
-    int i,j;
+    /* the variable used in the loop */
+    int i;
 	for(i = 0;i < numprocs;i++) {
 		displs[i] = offset;
 		offset += sendcounts[i];
 	}
+    /* the file decides how many points there are */
+    if (offset != lineNums && rank == 0) {
+        printf("%s holds %d points, not %d\n", filename, offset, lineNums);
+    }
+    lineNums = offset;
+    
+    /* Step 4 and 5 for every k of a sweep instead, on the points loaded above */
+    if (options.sweepNums > 0) {
+        sweepClusters(MPI_COMM_WORLD, &Recvbuf2D, &handleRows, displs[rank], lineNums, dimension, &unresolved);
+        free(sendcounts);
+        free(displs);
+        freePartition(Recvbuf2D, &window);
+        free(TwoDCentroids);
+        writeTimingReport(MPI_COMM_WORLD, options.timing);
+        MPI_Finalize();
+        return 0;
+    }
     
-	/* scatter the data and broadcast the centroids*/
-	MPI_Scatterv (TwoDSource,sendcounts,displs,MPI_DOUBLE,Recvbuf2D,handleNumbers,MPI_DOUBLE,0,MPI_COMM_WORLD);
-    MPI_Bcast (TwoDCentroids,cluster * dimension,MPI_DOUBLE,0,MPI_COMM_WORLD);
+    
+    
+    
+    /* Step 4: Generating centroids */
+    
+    beginPhase(PHASE_SEED);
+    /* k-means|| needs the rows in memory, a streamed run seeds with k-means++ instead */
+    if (options.init == INIT_KMEANSPARALLEL && SingleRecvbuf != NULL) {
+        /* the float rows are sampled as they are, the seeds widened afterwards */
+        float* seeds = malloc(sizeof(float) * cluster * dimension);
+        kmeansParallel(comm, SingleRecvbuf, handleRows, displs[rank], lineNums, sizeof(float) * dimension,
+                       dimension, singleSeedDistance, cluster, seeds);
+        widenRows(seeds, (size_t)cluster * dimension, TwoDCentroids);
+        free(seeds);
+    } else if (options.init == INIT_KMEANSPARALLEL && stream == NULL) {
+        /* every process samples its own rows and all of them end up with the centroids */
+        kmeansParallel(comm, Recvbuf2D, handleRows, displs[rank], lineNums, sizeof(double) * dimension,
+                       dimension, vectorSeedDistance, cluster, TwoDCentroids);
+    } else {
+        /* the master of the group picks the centroids among candidate rows fetched from their owners */
+        int candidateNums;
+        int* candidates = seedCandidates(lineNums, cluster, &candidateNums);
+        double* candidateRows = malloc(sizeof(double) * candidateNums * dimension);
+        MPI_Bcast(candidates, candidateNums, MPI_INT, 0, comm);
+        if (stream != NULL) {
+            /* the master reads the candidates straight from the file */
+            if (rank == 0) {
+                readDatasetRows(filename, &header, candidates, candidateNums, candidateRows);
+            }
+        } else if (SingleRecvbuf != NULL) {
+            /* the candidates travel as floats and are seeded as doubles */
+            float* singleCandidates = malloc(sizeof(float) * candidateNums * dimension);
+            fetchRows(comm, 0, candidates, candidateNums, SingleRecvbuf, displs[rank], handleRows,
+                      sizeof(float) * dimension, singleCandidates);
+            if (rank == 0) {
+                widenRows(singleCandidates, (size_t)candidateNums * dimension, candidateRows);
+            }
+            free(singleCandidates);
+        } else {
+            fetchRows(comm, 0, candidates, candidateNums, Recvbuf2D, displs[rank], handleRows,
+                      sizeof(double) * dimension, candidateRows);
+        }
+        if (rank == 0) {
+            if (options.init != INIT_RANDOM) {
+                kmeansPlusPlus(candidateRows, NULL, candidateNums, sizeof(double) * dimension, dimension,
+                               vectorSeedDistance, cluster, TwoDCentroids);
+            } else if (!generate2DCentroids(TwoDCentroids, candidateRows, candidateNums, dimension, cluster)) {
+                /* fewer distinct points than clusters, k-means++ repeats some of them */
+                printf("--init random found no %d points far enough apart, seeding with k-means++\n", cluster);
+                kmeansPlusPlus(candidateRows, NULL, candidateNums, sizeof(double) * dimension, dimension,
+                               vectorSeedDistance, cluster, TwoDCentroids);
+            }
+        }
+        free(candidates);
+        free(candidateRows);
+        
+        /* broadcast the centroids*/
+        MPI_Bcast (TwoDCentroids,cluster * dimension,MPI_DOUBLE,0,comm);
+    }
+    endPhase(PHASE_SEED);
     
     
     
@@ -153,115 +393,67 @@ int main(int argc,char** argv){
     /* Step5: K-Means Calculating */
     
     /* categorized all the points or DNA strands into different clusters for each processor*/
-    int handleRows = sendcounts[rank] / dimension;
-//    printf("handleRows : %d\n", handleRows);
-    int* categories = malloc(sizeof(int) * handleRows);
+    int* categories = NULL;
     /* all the labels of all the points on the master process */
-	int* totalCategories = malloc(sizeof(int)*lineNums);
-    
-    do {
-        
-        /* the flag for temination of the while loop */
-        int flag = 0;
-        
-        /* the distributed centroids from master node */
-        double* distributedCentroids = malloc(sizeof(double) * cluster * dimension);
-        /* the new generated centroids */
-        double* newGeneratedCentroids = malloc(sizeof(double) * cluster * dimension);
-        memset(newGeneratedCentroids, 0, sizeof(double) * cluster * dimension);
-        /* the numbers of points in distributed contents */
-        int* distributedPoints = malloc(sizeof(int) * cluster);
-        /* the numbers of new generated points in each processor */
-        int* newGeneratedPoints = malloc(sizeof(int) * cluster);
-        memset(newGeneratedPoints, 0, sizeof(int) * cluster);
+	int* totalCategories = NULL;
+    
+    /* the iterations run by the k-means engine and how long they took */
+    int iterations;
+    /* the group whose result is kept */
+    int best = 0;
+    double kmeansTime = MPI_Wtime();
+    
+    if (stream != NULL) {
+        /* the labels of every process go to their place in the label file, or spill to a file of its own */
+        MPI_File labels = options.labels != NULL ? openLabelFile(comm, options.labels, displs[rank])
+                                                 : openSpillFile(options.spill, rank);
+        iterations = vectorKMeansStream(comm, stream, dimension, cluster, &options, TwoDCentroids, labels);
+        MPI_File_close(&labels);
+        closeRowStream(stream);
+    } else {
+        categories = malloc(sizeof(int) * handleRows);
+        if (SingleRecvbuf != NULL) {
+            iterations = vectorKMeansSingle(comm, SingleRecvbuf, handleRows, dimension, cluster, &options,
+                                            TwoDCentroids, categories);
+        } else {
+            iterations = vectorKMeans(comm, &Recvbuf2D, &handleRows, dimension, cluster, &options, TwoDCentroids, &categories);
+        }
         
-        /* Calculate the category and new Centroids' sum */
-        for(i = 0; i < handleRows; i++) {
-            int category = -1;
-            double TwoDmaxDiff = MAX_DIFF;
-            
-            for(j = 0; j < cluster; j++) {
-                // printf("TwoDCentroids[j*d] : %lf\n", TwoDCentroids[j * dimension]);
-                double calculatedDistance = TwoDDistance(TwoDCentroids + j * dimension, Recvbuf2D + i * dimension);
-                int k;
-                for( k = 0; k <  1; k++) {
-                    // printf("Recvbuf2D [0] :%lf\n", Recvbuf2D[k * dimension]);
-                }
-                if (calculatedDistance < TwoDmaxDiff) {
-                    TwoDmaxDiff =calculatedDistance;
-                    category = j;
-                }
-                
+        if (options.restarts > 1) {
+            /* only the labels and centroids of the cheapest run are kept */
+            double cost = SingleRecvbuf != NULL
+                              ? vectorCostSingle(SingleRecvbuf, handleRows, dimension, TwoDCentroids, categories)
+                              : vectorCost(Recvbuf2D, handleRows, dimension, TwoDCentroids, categories);
+            best = bestRestart(MPI_COMM_WORLD, comm, restart, cost, &cost);
+            if (rank == 0) {
+                printf("Restart %d: within-cluster sum of squares %g after %d iterations.\n", restart, cost, iterations);
             }
-            categories[i] = category;
-            newGeneratedPoints[category]++;
-            /* sum each point */
-            for (j = 0; j < dimension; j++) {
-                newGeneratedCentroids[category * dimension + j] += Recvbuf2D[i * dimension + j];
-            }
-            
-            
-            
         }
         
-        //int k;
-        // for( k = 0; k <  2; k++) {
-        //         printf("points :%lf\n", newGeneratedPoints[k]);
-        //         printf("newGeneratedCentroids : %lf\n", newGeneratedCentroids[k]);
-        //     }
-        
-        /* reduce step - new centroid sum to the master process */
-        MPI_Reduce(newGeneratedCentroids, distributedCentroids, cluster * dimension, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-        /* reduce step - the cluster counts to the master process */
-        MPI_Reduce(newGeneratedPoints, distributedPoints, cluster, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-        
-        /* handle the results from different processor */
-        if (rank == 0){
-            /* intilize the difference sum */
-            double sumDistance = 0;
-            
-            /* calculate new centroids' average value */
-            for (i = 0; i < cluster; i++) {
-                for (j = 0; j < dimension; j++) {
-                    distributedCentroids[i * dimension + j] /= distributedPoints[i];
+        beginPhase(PHASE_GATHER);
+        if (restart == best && options.labels != NULL) {
+            /* every process writes its own labels in place, nothing is gathered */
+            writeLabels(comm, options.labels, options.labelsFormat, categories, handleRows);
+        } else if (restart == best) {
+            /* gather all the labels of all the points on the master process */
+            totalCategories = malloc(sizeof(int)*lineNums);
+            if (options.rebalance > 0) {
+                /* the rows may have moved between the processes */
+                MPI_Allgather(&handleRows, 1, MPI_INT, sendcounts, 1, MPI_INT, comm);
+                for (i = 1; i < numprocs; i++) {
+                    displs[i] = displs[i - 1] + sendcounts[i - 1];
                 }
             }
-            
-            /* iterate each cluster and update the sum */
-            for (i = 0; i < cluster; i++) {
-                sumDistance += TwoDDistance(distributedCentroids + i * dimension,TwoDCentroids + i * dimension);
-            }
-            /* if the difference is less than a threshold, set the termination flag */
-            if (sumDistance < TwoD_DIFF_THRESHOLD) {
-                flag = 1;
-            }
-            /* free the TwoDCentroids and give the TwoDCentroids new values */
-            free(TwoDCentroids);
-            TwoDCentroids = distributedCentroids;
+            MPI_Gatherv (categories,handleRows,MPI_INT,totalCategories,sendcounts,displs,MPI_INT,0,comm);
         }
-        /* broadcast the temination flag */
-        MPI_Bcast (&flag,1,MPI_INT,0,MPI_COMM_WORLD);
-        
-        free(newGeneratedPoints);
-        free(distributedPoints);
-        free(newGeneratedCentroids);
-        
-        if(flag) {
-            break;
-        }
-        
-        /* broadcast the new centroids */
-        MPI_Bcast (TwoDCentroids,cluster * dimension,MPI_DOUBLE,0,MPI_COMM_WORLD);
-    } while (1);
+        endPhase(PHASE_GATHER);
+    }
+    kmeansTime = MPI_Wtime() - kmeansTime;
     
-    /* gather all the labels of all the points on the master process */
-	int displacement = 0;
-	for(i = 0;i < numprocs;i++) {
-		sendcounts[i] /= dimension;
-		displs[i] = displacement;
-		displacement += sendcounts[i];
-	}
-	MPI_Gatherv (categories,handleRows,MPI_INT,totalCategories,sendcounts,displs,MPI_INT,0,MPI_COMM_WORLD);
+    /* every process holds the same centroids, the master keeps them */
+    if (rank == 0 && restart == best && options.centroids != NULL) {
+        write2DCentroids(options.centroids, TwoDCentroids, cluster, dimension);
+    }
 	
 	
     
@@ -271,12 +463,24 @@ int main(int argc,char** argv){
 	free(displs);
 	free(categories);
 	free(totalCategories);
-    free(TwoDSource);
-    free(Recvbuf2D);
+    freePartition(Recvbuf2D, &window);
+    free(SingleRecvbuf);
     free(TwoDCentroids);
     
     /*get the time just after work is done and take the difference */
     endwtime = MPI_Wtime();
+    if (rank == 0 && restart == best) {
+        if (options.restarts > 1) {
+            printf("Kept restart %d of %d.\n", best, options.restarts);
+        }
+        printf("K-Means converged after %d iterations.\n", iterations);
+        printf("K-Means took %lf seconds.\n", kmeansTime);
+    }
     printf("Timing span of this job is %lf seconds.\n",endwtime-startwtime);
+    /* the phase times of every process, see timing.h */
+    writeTimingReport(MPI_COMM_WORLD, options.timing);
+    if (comm != MPI_COMM_WORLD) {
+        MPI_Comm_free(&comm);
+    }
 	MPI_Finalize();
 }
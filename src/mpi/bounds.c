@@ -0,0 +1,437 @@
+#include <stddef.h>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include "bounds.h"
+#include "util.h"
+#include "vecdist.h"
+#include "dnapack.h"
+
+/*
+ * the Euclidean distance the bounds are kept in
+ */
+static inline double boundDistance(const double* a, const double* b, int dimension) {
+    return sqrt(squaredDistance(a, b, dimension));
+}
+
+/*
+ * the number of lower bounds kept for each row
+ */
+int lowerBoundsPerRow(int prune, int cluster) {
+    return prune == PRUNE_ELKAN ? cluster : 1;
+}
+
+/*
+ * half the distance between every pair of centroids (Elkan only, may be
+ * NULL otherwise) and half the distance from each centroid to its closest
+ * other one
+ */
+void centroidSeparation(const double* centroids, int cluster, int dimension,
+                        double* halfDistances, double* separation) {
+    int j, k;
+    for (j = 0; j < cluster; j++) {
+        separation[j] = DBL_MAX;
+    }
+    for (j = 0; j < cluster; j++) {
+        for (k = j + 1; k < cluster; k++) {
+            double half = boundDistance(centroids + (size_t)j * dimension, centroids + (size_t)k * dimension, dimension) / 2;
+            if (halfDistances != NULL) {
+                halfDistances[(size_t)j * cluster + k] = half;
+                halfDistances[(size_t)k * cluster + j] = half;
+            }
+            if (half < separation[j]) {
+                separation[j] = half;
+            }
+            if (half < separation[k]) {
+                separation[k] = half;
+            }
+        }
+    }
+}
+
+/*
+ * compare one row against every centroid, keeping the closest and second
+ * closest distances and, for Elkan, every distance as a lower bound
+ */
+static int scanAllCentroids(int prune, const double* point, int dimension, const double* centroids, int cluster,
+                            double* upper, double* lower) {
+    int j;
+    int category = -1;
+    double best = DBL_MAX;
+    double second = DBL_MAX;
+
+    for (j = 0; j < cluster; j++) {
+        double distance = boundDistance(point, centroids + (size_t)j * dimension, dimension);
+        if (prune == PRUNE_ELKAN) {
+            lower[j] = distance;
+        }
+        if (distance < best) {
+            second = best;
+            best = distance;
+            category = j;
+        } else if (distance < second) {
+            second = distance;
+        }
+    }
+    *upper = best;
+    if (prune == PRUNE_HAMERLY) {
+        *lower = second;
+    }
+    return category;
+}
+
+/*
+ * the first assignment: exact distances to every centroid set the
+ * categories and the bounds of rows [begin, end). Returns the number of
+ * distances computed.
+ */
+long long initVectorBounds(int prune, const double* rows, int begin, int end, int dimension,
+                           const double* centroids, int cluster,
+                           int* categories, double* upper, double* lower) {
+    int i;
+    int perRow = lowerBoundsPerRow(prune, cluster);
+    for (i = begin; i < end; i++) {
+        categories[i] = scanAllCentroids(prune, rows + (size_t)i * dimension, dimension, centroids, cluster,
+                                         upper + i, lower + (size_t)i * perRow);
+    }
+    return (long long)(end - begin) * cluster;
+}
+
+/*
+ * Hamerly : a row keeps its centroid while the upper bound stays below both
+ * the lower bound and half the distance to the closest other centroid
+ */
+static long long hamerlyAssign(const double* rows, int begin, int end, int dimension,
+                               const double* centroids, int cluster, const double* separation,
+                               int* categories, double* upper, double* lower) {
+    long long distances = 0;
+    int i;
+    for (i = begin; i < end; i++) {
+        const double* point = rows + (size_t)i * dimension;
+        int category = categories[i];
+        double bound = separation[category] > lower[i] ? separation[category] : lower[i];
+
+        if (upper[i] <= bound) {
+            continue;
+        }
+        /* tighten the upper bound before giving up on the row */
+        upper[i] = boundDistance(point, centroids + (size_t)category * dimension, dimension);
+        distances++;
+        if (upper[i] <= bound) {
+            continue;
+        }
+        categories[i] = scanAllCentroids(PRUNE_HAMERLY, point, dimension, centroids, cluster, upper + i, lower + i);
+        distances += cluster;
+    }
+    return distances;
+}
+
+/*
+ * Elkan : each centroid is ruled out by its own lower bound or by half its
+ * distance to the current centroid
+ */
+static long long elkanAssign(const double* rows, int begin, int end, int dimension,
+                             const double* centroids, int cluster,
+                             const double* halfDistances, const double* separation,
+                             int* categories, double* upper, double* lower) {
+    long long distances = 0;
+    int i, j;
+    for (i = begin; i < end; i++) {
+        const double* point = rows + (size_t)i * dimension;
+        double* rowLower = lower + (size_t)i * cluster;
+        int category = categories[i];
+        int tight = 0;
+
+        if (upper[i] <= separation[category]) {
+            continue;
+        }
+        for (j = 0; j < cluster; j++) {
+            double distance;
+            if (j == category || upper[i] <= rowLower[j] || upper[i] <= halfDistances[(size_t)category * cluster + j]) {
+                continue;
+            }
+            /* tighten the upper bound once before comparing against the others */
+            if (!tight) {
+                upper[i] = boundDistance(point, centroids + (size_t)category * dimension, dimension);
+                rowLower[category] = upper[i];
+                distances++;
+                tight = 1;
+                if (upper[i] <= rowLower[j] || upper[i] <= halfDistances[(size_t)category * cluster + j]) {
+                    continue;
+                }
+            }
+            distance = boundDistance(point, centroids + (size_t)j * dimension, dimension);
+            rowLower[j] = distance;
+            distances++;
+            if (distance < upper[i]) {
+                category = j;
+                upper[i] = distance;
+            }
+        }
+        categories[i] = category;
+    }
+    return distances;
+}
+
+/*
+ * assign rows [begin, end) skipping the centroids the bounds rule out.
+ * Returns the number of distances computed.
+ */
+long long boundedVectorAssign(int prune, const double* rows, int begin, int end, int dimension,
+                              const double* centroids, int cluster,
+                              const double* halfDistances, const double* separation,
+                              int* categories, double* upper, double* lower) {
+    if (prune == PRUNE_ELKAN) {
+        return elkanAssign(rows, begin, end, dimension, centroids, cluster, halfDistances, separation,
+                           categories, upper, lower);
+    }
+    return hamerlyAssign(rows, begin, end, dimension, centroids, cluster, separation, categories, upper, lower);
+}
+
+/*
+ * loosen the bounds of rows [begin, end) after the centroids moved by drift
+ */
+void shiftVectorBounds(int prune, int begin, int end, int cluster, const double* drift,
+                       const int* categories, double* upper, double* lower) {
+    int i, j;
+
+    if (prune == PRUNE_ELKAN) {
+        for (i = begin; i < end; i++) {
+            double* rowLower = lower + (size_t)i * cluster;
+            upper[i] += drift[categories[i]];
+            for (j = 0; j < cluster; j++) {
+                rowLower[j] = rowLower[j] > drift[j] ? rowLower[j] - drift[j] : 0;
+            }
+        }
+        return;
+    }
+
+    /* Hamerly : the single lower bound drops by the largest drift of the other centroids */
+    {
+        int farthest = 0;
+        double largest = 0;
+        double secondLargest = 0;
+        for (j = 0; j < cluster; j++) {
+            if (drift[j] > largest) {
+                secondLargest = largest;
+                largest = drift[j];
+                farthest = j;
+            } else if (drift[j] > secondLargest) {
+                secondLargest = drift[j];
+            }
+        }
+        for (i = begin; i < end; i++) {
+            upper[i] += drift[categories[i]];
+            lower[i] -= categories[i] == farthest ? secondLargest : largest;
+        }
+    }
+}
+
+/*
+ * DNA : the Hamming distance between every pair of centroids (Elkan only,
+ * may be NULL otherwise) and from each centroid to its closest other one
+ */
+void dnaCentroidSeparation(const uint64_t* centroids, int cluster, int words,
+                           int* centroidDistances, int* separation) {
+    int j, k;
+    for (j = 0; j < cluster; j++) {
+        separation[j] = INT_MAX;
+    }
+    for (j = 0; j < cluster; j++) {
+        for (k = j + 1; k < cluster; k++) {
+            int distance = packedDNADistance(centroids + (size_t)j * words, centroids + (size_t)k * words, words);
+            if (centroidDistances != NULL) {
+                centroidDistances[(size_t)j * cluster + k] = distance;
+                centroidDistances[(size_t)k * cluster + j] = distance;
+            }
+            if (distance < separation[j]) {
+                separation[j] = distance;
+            }
+            if (distance < separation[k]) {
+                separation[k] = distance;
+            }
+        }
+    }
+}
+
+/*
+ * DNA : compare one strand against every centroid, keeping the closest and
+ * second closest distances and, for Elkan, every distance as a lower bound
+ */
+static int scanAllDNACentroids(int prune, const uint64_t* strand, int words, const uint64_t* centroids, int cluster,
+                               int* upper, int* lower) {
+    int j;
+    int category = -1;
+    int best = INT_MAX;
+    int second = INT_MAX;
+
+    for (j = 0; j < cluster; j++) {
+        int distance = packedDNADistance(centroids + (size_t)j * words, strand, words);
+        if (prune == PRUNE_ELKAN) {
+            lower[j] = distance;
+        }
+        if (distance < best) {
+            second = best;
+            best = distance;
+            category = j;
+        } else if (distance < second) {
+            second = distance;
+        }
+    }
+    *upper = best;
+    if (prune == PRUNE_HAMERLY) {
+        *lower = second;
+    }
+    return category;
+}
+
+/*
+ * DNA : the first assignment, exact distances to every centroid set the
+ * categories and the bounds of strands [begin, end). Returns the number
+ * of distances computed.
+ */
+long long initDNABounds(int prune, const uint64_t* rows, int begin, int end, int words,
+                        const uint64_t* centroids, int cluster,
+                        int* categories, int* upper, int* lower) {
+    int i;
+    int perRow = lowerBoundsPerRow(prune, cluster);
+    for (i = begin; i < end; i++) {
+        categories[i] = scanAllDNACentroids(prune, rows + (size_t)i * words, words, centroids, cluster,
+                                            upper + i, lower + (size_t)i * perRow);
+    }
+    return (long long)(end - begin) * cluster;
+}
+
+/*
+ * DNA Hamerly : every other centroid is strictly farther when the upper
+ * bound is below the lower bound or below half the distance to the
+ * closest other centroid
+ */
+static long long hamerlyDNAAssign(const uint64_t* rows, int begin, int end, int words,
+                                  const uint64_t* centroids, int cluster, const int* separation,
+                                  int* categories, int* upper, int* lower) {
+    long long distances = 0;
+    int i;
+    for (i = begin; i < end; i++) {
+        const uint64_t* strand = rows + (size_t)i * words;
+        int category = categories[i];
+
+        if (upper[i] < lower[i] || 2 * upper[i] < separation[category]) {
+            continue;
+        }
+        /* tighten the upper bound before giving up on the strand */
+        upper[i] = packedDNADistance(centroids + (size_t)category * words, strand, words);
+        distances++;
+        if (upper[i] < lower[i] || 2 * upper[i] < separation[category]) {
+            continue;
+        }
+        categories[i] = scanAllDNACentroids(PRUNE_HAMERLY, strand, words, centroids, cluster, upper + i, lower + i);
+        distances += cluster;
+    }
+    return distances;
+}
+
+/*
+ * DNA Elkan : each centroid is ruled out by its own lower bound or by half
+ * its distance to the current centroid
+ */
+static long long elkanDNAAssign(const uint64_t* rows, int begin, int end, int words,
+                                const uint64_t* centroids, int cluster,
+                                const int* centroidDistances, const int* separation,
+                                int* categories, int* upper, int* lower) {
+    long long distances = 0;
+    int i, j;
+    for (i = begin; i < end; i++) {
+        const uint64_t* strand = rows + (size_t)i * words;
+        int* rowLower = lower + (size_t)i * cluster;
+        int category = categories[i];
+        int tight = 0;
+
+        if (2 * upper[i] < separation[category]) {
+            continue;
+        }
+        for (j = 0; j < cluster; j++) {
+            int distance;
+            if (j == category || upper[i] < rowLower[j] || 2 * upper[i] < centroidDistances[(size_t)category * cluster + j]) {
+                continue;
+            }
+            /* tighten the upper bound once before comparing against the others */
+            if (!tight) {
+                upper[i] = packedDNADistance(centroids + (size_t)category * words, strand, words);
+                rowLower[category] = upper[i];
+                distances++;
+                tight = 1;
+                if (upper[i] < rowLower[j] || 2 * upper[i] < centroidDistances[(size_t)category * cluster + j]) {
+                    continue;
+                }
+            }
+            distance = packedDNADistance(centroids + (size_t)j * words, strand, words);
+            rowLower[j] = distance;
+            distances++;
+            /* a tie goes to the lower index, as in the full scan */
+            if (distance < upper[i] || (distance == upper[i] && j < category)) {
+                category = j;
+                upper[i] = distance;
+            }
+        }
+        categories[i] = category;
+    }
+    return distances;
+}
+
+/*
+ * DNA : assign strands [begin, end) skipping the centroids the bounds rule
+ * out. The bounds are compared strictly so that ties are still decided
+ * like the full scan, in favour of the lowest cluster index. Returns the
+ * number of distances computed.
+ */
+long long boundedDNAAssign(int prune, const uint64_t* rows, int begin, int end, int words,
+                           const uint64_t* centroids, int cluster,
+                           const int* centroidDistances, const int* separation,
+                           int* categories, int* upper, int* lower) {
+    if (prune == PRUNE_ELKAN) {
+        return elkanDNAAssign(rows, begin, end, words, centroids, cluster, centroidDistances, separation,
+                              categories, upper, lower);
+    }
+    return hamerlyDNAAssign(rows, begin, end, words, centroids, cluster, separation, categories, upper, lower);
+}
+
+/*
+ * DNA : loosen the bounds of strands [begin, end) after the consensus of
+ * each centroid changed in drift bases
+ */
+void shiftDNABounds(int prune, int begin, int end, int cluster, const int* drift,
+                    const int* categories, int* upper, int* lower) {
+    int i, j;
+
+    if (prune == PRUNE_ELKAN) {
+        for (i = begin; i < end; i++) {
+            int* rowLower = lower + (size_t)i * cluster;
+            upper[i] += drift[categories[i]];
+            for (j = 0; j < cluster; j++) {
+                rowLower[j] = rowLower[j] > drift[j] ? rowLower[j] - drift[j] : 0;
+            }
+        }
+        return;
+    }
+
+    /* Hamerly : the single lower bound drops by the largest drift of the other centroids */
+    {
+        int farthest = 0;
+        int largest = 0;
+        int secondLargest = 0;
+        for (j = 0; j < cluster; j++) {
+            if (drift[j] > largest) {
+                secondLargest = largest;
+                largest = drift[j];
+                farthest = j;
+            } else if (drift[j] > secondLargest) {
+                secondLargest = drift[j];
+            }
+        }
+        for (i = begin; i < end; i++) {
+            upper[i] += drift[categories[i]];
+            lower[i] -= categories[i] == farthest ? secondLargest : largest;
+        }
+    }
+}
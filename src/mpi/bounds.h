@@ -0,0 +1,88 @@
+#ifndef _BOUNDS_H_
+#define _BOUNDS_H_
+
+#include <stdint.h>
+
+/*
+ * Bound based assignment for the k-means engines. Every row keeps an upper
+ * bound on the distance to its centroid and lower bounds on the distance
+ * to the others: one for all of them with Hamerly, one per centroid with
+ * Elkan. When the centroids move the bounds are loosened by the drift, and
+ * a row is only compared against the centroids the bounds cannot rule out.
+ * The vector distances are Euclidean, the triangle inequality needs the
+ * root. The DNA distances are Hamming distances, the drift of a centroid
+ * is the number of bases its consensus changed.
+ */
+
+/*
+ * the number of lower bounds kept for each row
+ */
+int lowerBoundsPerRow(int prune, int cluster);
+
+/*
+ * half the distance between every pair of centroids (Elkan only, may be
+ * NULL otherwise) and half the distance from each centroid to its closest
+ * other one
+ */
+void centroidSeparation(const double* centroids, int cluster, int dimension,
+                        double* halfDistances, double* separation);
+
+/*
+ * the first assignment: exact distances to every centroid set the
+ * categories and the bounds of rows [begin, end). Returns the number of
+ * distances computed.
+ */
+long long initVectorBounds(int prune, const double* rows, int begin, int end, int dimension,
+                           const double* centroids, int cluster,
+                           int* categories, double* upper, double* lower);
+
+/*
+ * assign rows [begin, end) skipping the centroids the bounds rule out.
+ * Returns the number of distances computed.
+ */
+long long boundedVectorAssign(int prune, const double* rows, int begin, int end, int dimension,
+                              const double* centroids, int cluster,
+                              const double* halfDistances, const double* separation,
+                              int* categories, double* upper, double* lower);
+
+/*
+ * loosen the bounds of rows [begin, end) after the centroids moved by drift
+ */
+void shiftVectorBounds(int prune, int begin, int end, int cluster, const double* drift,
+                       const int* categories, double* upper, double* lower);
+
+/*
+ * DNA : the Hamming distance between every pair of centroids (Elkan only,
+ * may be NULL otherwise) and from each centroid to its closest other one
+ */
+void dnaCentroidSeparation(const uint64_t* centroids, int cluster, int words,
+                           int* centroidDistances, int* separation);
+
+/*
+ * DNA : the first assignment, exact distances to every centroid set the
+ * categories and the bounds of strands [begin, end). Returns the number
+ * of distances computed.
+ */
+long long initDNABounds(int prune, const uint64_t* rows, int begin, int end, int words,
+                        const uint64_t* centroids, int cluster,
+                        int* categories, int* upper, int* lower);
+
+/*
+ * DNA : assign strands [begin, end) skipping the centroids the bounds rule
+ * out. The bounds are compared strictly so that ties are still decided
+ * like the full scan, in favour of the lowest cluster index. Returns the
+ * number of distances computed.
+ */
+long long boundedDNAAssign(int prune, const uint64_t* rows, int begin, int end, int words,
+                           const uint64_t* centroids, int cluster,
+                           const int* centroidDistances, const int* separation,
+                           int* categories, int* upper, int* lower);
+
+/*
+ * DNA : loosen the bounds of strands [begin, end) after the consensus of
+ * each centroid changed in drift bases
+ */
+void shiftDNABounds(int prune, int begin, int end, int cluster, const int* drift,
+                    const int* categories, int* upper, int* lower);
+
+#endif
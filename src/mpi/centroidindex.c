@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <float.h>
+#include "centroidindex.h"
+#include "vecdist.h"
+
+/*
+ * a node of the tree holds the centroids order[begin, end). An inner node
+ * splits them at split along axis: left has the coordinates up to split,
+ * right the ones from split on. A leaf has no children.
+ */
+typedef struct {
+    int begin;
+    int end;
+    int axis;
+    double split;
+    int left;
+    int right;
+} KdNode;
+
+struct CentroidIndex {
+    int cluster;
+    int dimension;
+    const double* centroids;
+    /* the centroid indices, grouped by node */
+    int* order;
+    KdNode* nodes;
+    int nodeNums;
+};
+
+/*
+ * an empty index for cluster centroids of the given dimension
+ */
+CentroidIndex* createCentroidIndex(int cluster, int dimension) {
+    CentroidIndex* index = malloc(sizeof(CentroidIndex));
+    index->cluster = cluster;
+    index->dimension = dimension;
+    index->centroids = NULL;
+    index->order = malloc(sizeof(int) * cluster);
+    /* a binary tree with at least one centroid per leaf has fewer than 2 * cluster nodes */
+    index->nodes = malloc(sizeof(KdNode) * 2 * (cluster > 0 ? cluster : 1));
+    index->nodeNums = 0;
+    return index;
+}
+
+/*
+ * the coordinate of the centroid at position i of order along axis
+ */
+static double coordinate(const CentroidIndex* index, int i, int axis) {
+    return index->centroids[(size_t)index->order[i] * index->dimension + axis];
+}
+
+/*
+ * reorder order[begin, end) so that position k holds the centroid that
+ * belongs there when sorted along axis, smaller ones before it, larger
+ * ones after it
+ */
+static void selectCentroid(CentroidIndex* index, int begin, int end, int k, int axis) {
+    int* order = index->order;
+    while (end - begin > 1) {
+        double pivot = coordinate(index, begin + (end - begin) / 2, axis);
+        int low = begin;
+        int high = end - 1;
+        while (low <= high) {
+            while (coordinate(index, low, axis) < pivot) {
+                low++;
+            }
+            while (coordinate(index, high, axis) > pivot) {
+                high--;
+            }
+            if (low <= high) {
+                int swap = order[low];
+                order[low++] = order[high];
+                order[high--] = swap;
+            }
+        }
+        if (k <= high) {
+            end = high + 1;
+        } else if (k >= low) {
+            begin = low;
+        } else {
+            return;
+        }
+    }
+}
+
+/*
+ * build the subtree over order[begin, end), returns its node
+ */
+static int buildNode(CentroidIndex* index, int begin, int end) {
+    int node = index->nodeNums++;
+    KdNode* n = index->nodes + node;
+    int i, d;
+    int middle;
+    double widest = -1;
+
+    n->begin = begin;
+    n->end = end;
+    n->left = -1;
+    n->right = -1;
+    if (end - begin <= KDTREE_LEAF_SIZE) {
+        return node;
+    }
+
+    /* split along the dimension the centroids spread the most in */
+    for (d = 0; d < index->dimension; d++) {
+        double low = DBL_MAX;
+        double high = -DBL_MAX;
+        for (i = begin; i < end; i++) {
+            double value = coordinate(index, i, d);
+            low = value < low ? value : low;
+            high = value > high ? value : high;
+        }
+        if (high - low > widest) {
+            widest = high - low;
+            n->axis = d;
+        }
+    }
+    middle = begin + (end - begin) / 2;
+    selectCentroid(index, begin, end, middle, n->axis);
+    n->split = coordinate(index, middle, n->axis);
+
+    n->left = buildNode(index, begin, middle);
+    n->right = buildNode(index, middle, end);
+    return node;
+}
+
+/*
+ * build the tree over the current centroids, which must stay in place
+ * until the next rebuild
+ */
+void rebuildCentroidIndex(CentroidIndex* index, const double* centroids) {
+    int i;
+    index->centroids = centroids;
+    for (i = 0; i < index->cluster; i++) {
+        index->order[i] = i;
+    }
+    index->nodeNums = 0;
+    if (index->cluster > 0) {
+        buildNode(index, 0, index->cluster);
+    }
+}
+
+/*
+ * visit the near child first and the far one only while the splitting
+ * plane is not farther than the best centroid so far
+ */
+static void searchNode(const CentroidIndex* index, int node, const double* point, int* best, double* bestDistance,
+                       long long* distances) {
+    const KdNode* n = index->nodes + node;
+    double diff;
+
+    if (n->left < 0) {
+        int i;
+        *distances += n->end - n->begin;
+        for (i = n->begin; i < n->end; i++) {
+            int category = index->order[i];
+            double d = squaredDistance(point, index->centroids + (size_t)category * index->dimension, index->dimension);
+            if (d < *bestDistance || (d == *bestDistance && category < *best)) {
+                *bestDistance = d;
+                *best = category;
+            }
+        }
+        return;
+    }
+
+    diff = point[n->axis] - n->split;
+    if (diff < 0) {
+        searchNode(index, n->left, point, best, bestDistance, distances);
+        if (diff * diff <= *bestDistance) {
+            searchNode(index, n->right, point, best, bestDistance, distances);
+        }
+    } else {
+        searchNode(index, n->right, point, best, bestDistance, distances);
+        if (diff * diff <= *bestDistance) {
+            searchNode(index, n->left, point, best, bestDistance, distances);
+        }
+    }
+}
+
+/*
+ * the index of the nearest centroid, its squared distance is stored in
+ * distance unless it is NULL. The number of distances computed is added
+ * to distances unless it is NULL.
+ */
+int nearestIndexedCentroid(const CentroidIndex* index, const double* point, double* distance, long long* distances) {
+    int best = -1;
+    double bestDistance = DBL_MAX;
+    long long computed = 0;
+    if (index->nodeNums > 0) {
+        searchNode(index, 0, point, &best, &bestDistance, &computed);
+    }
+    if (distances != NULL) {
+        *distances += computed;
+    }
+    if (distance != NULL) {
+        *distance = bestDistance;
+    }
+    return best;
+}
+
+void freeCentroidIndex(CentroidIndex* index) {
+    free(index->order);
+    free(index->nodes);
+    free(index);
+}
@@ -0,0 +1,38 @@
+#ifndef _CENTROIDINDEX_H_
+#define _CENTROIDINDEX_H_
+
+/*
+ * A kd-tree over the centroids, rebuilt after every update, so that the
+ * nearest centroid of a point is found by visiting a few leaves instead of
+ * all cluster centroids. It pays off for many clusters in few dimensions,
+ * from about a hundred clusters in 2 or 3 dimensions; indexbench.c
+ * measures where it overtakes nearestCentroid. Equal distances are
+ * decided in favour of the lowest cluster index, like the linear scan.
+ */
+
+/* the most centroids kept in one leaf */
+#define KDTREE_LEAF_SIZE 8
+
+typedef struct CentroidIndex CentroidIndex;
+
+/*
+ * an empty index for cluster centroids of the given dimension
+ */
+CentroidIndex* createCentroidIndex(int cluster, int dimension);
+
+/*
+ * build the tree over the current centroids, which must stay in place
+ * until the next rebuild
+ */
+void rebuildCentroidIndex(CentroidIndex* index, const double* centroids);
+
+/*
+ * the index of the nearest centroid, its squared distance is stored in
+ * distance unless it is NULL. The number of distances computed is added
+ * to distances unless it is NULL.
+ */
+int nearestIndexedCentroid(const CentroidIndex* index, const double* point, double* distance, long long* distances);
+
+void freeCentroidIndex(CentroidIndex* index);
+
+#endif
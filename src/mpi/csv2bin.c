@@ -0,0 +1,138 @@
+/*
+ * Convert the text inputs of TwoDKMeansMPI and DNAKMeansMPI to the binary
+ * data set format of dataset.h.
+ *
+ * Build: cc -O2 -o csv2bin csv2bin.c dataset.c dnapack.c
+ * Usage: csv2bin <2d|dna> <input file name> <output file name>
+ *
+ * The dimension is taken from the first line, every other line must match it.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "dataset.h"
+#include "dnapack.h"
+
+/*
+ * whether a line holds nothing but white space
+ */
+static int blankLine(const char* line) {
+    for (; *line; line++) {
+        if (!isspace((unsigned char)*line)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * 2D : parse the comma separated values of a line, returns how many were found
+ */
+static int parseValues(char* line, double* values, int capacity) {
+    int count = 0;
+    char* cursor = line;
+    while (1) {
+        char* next;
+        double value = strtod(cursor, &next);
+        if (next == cursor) {
+            break;
+        }
+        if (count < capacity) {
+            values[count] = value;
+        }
+        count++;
+        cursor = next;
+        while (*cursor == ',' || isspace((unsigned char)*cursor)) {
+            cursor++;
+        }
+    }
+    return count;
+}
+
+/*
+ * DNA : collect the bases of a line, returns how many were found
+ */
+static int parseBases(const char* line, char* strand, int capacity) {
+    int count = 0;
+    for (; *line; line++) {
+        if (isalpha((unsigned char)*line)) {
+            if (count < capacity) {
+                strand[count] = *line;
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+int main(int argc, char** argv) {
+    FILE* input;
+    FILE* output;
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    int dna;
+    int dimension = -1;
+    int64_t rows = 0;
+    double* values = NULL;
+    char* strand = NULL;
+    uint64_t* packed = NULL;
+
+    if (argc < 4 || (strcmp(argv[1], "2d") != 0 && strcmp(argv[1], "dna") != 0)) {
+        printf("Usage: csv2bin <2d|dna> <input file name> <output file name>\n");
+        exit(-1);
+    }
+    dna = strcmp(argv[1], "dna") == 0;
+
+    input = fopen(argv[2], "r");
+    if (input == NULL) {
+        printf("Cannot open file %s\n", argv[2]);
+        exit(-1);
+    }
+    output = fopen(argv[3], "wb");
+    if (output == NULL) {
+        printf("Cannot open file %s\n", argv[3]);
+        exit(-1);
+    }
+
+    /* the header is rewritten with the real row count at the end */
+    writeDatasetHeader(output, dna ? DATASET_DNA2BIT : DATASET_FLOAT64, 0, 0);
+
+    while (getline(&line, &lineCapacity, input) != -1) {
+        int count;
+        if (blankLine(line)) {
+            continue;
+        }
+        if (dimension < 0) {
+            /* the first line decides the dimension */
+            dimension = dna ? parseBases(line, NULL, 0) : parseValues(line, NULL, 0);
+            values = malloc(sizeof(double) * dimension);
+            strand = malloc(dimension);
+            packed = malloc(sizeof(uint64_t) * packedWords(dimension));
+        }
+        count = dna ? parseBases(line, strand, dimension) : parseValues(line, values, dimension);
+        if (count != dimension) {
+            printf("Line %lld has %d values instead of %d\n", (long long)rows + 1, count, dimension);
+            exit(-1);
+        }
+        if (dna) {
+            packDNA(strand, packed, dimension);
+            fwrite(packed, sizeof(uint64_t), packedWords(dimension), output);
+        } else {
+            fwrite(values, sizeof(double), dimension, output);
+        }
+        rows++;
+    }
+
+    writeDatasetHeader(output, dna ? DATASET_DNA2BIT : DATASET_FLOAT64, dimension > 0 ? dimension : 0, rows);
+    printf("%s: %lld rows of dimension %d\n", argv[3], (long long)rows, dimension);
+
+    fclose(input);
+    fclose(output);
+    free(line);
+    free(values);
+    free(strand);
+    free(packed);
+    return 0;
+}
@@ -0,0 +1,568 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "dataio.h"
+#include "dnapack.h"
+#include "util.h"
+
+/* the largest piece handed to a single MPI read or write call */
+#define READ_CHUNK (1 << 30)
+/* the step used to complete the last line past the end of the range */
+#define TAIL_CHUNK 65536
+
+/*
+ * read length bytes at offset with collective calls, every process
+ * makes the same number of calls even when it has nothing left to read
+ */
+static void readCollective(MPI_Comm comm, MPI_File fh, MPI_Offset offset, char* buffer, MPI_Offset length) {
+    long long rounds = (length + READ_CHUNK - 1) / READ_CHUNK;
+    long long maxRounds;
+    long long round;
+
+    MPI_Allreduce(&rounds, &maxRounds, 1, MPI_LONG_LONG, MPI_MAX, comm);
+    for (round = 0; round < maxRounds; round++) {
+        MPI_Offset done = round * (MPI_Offset)READ_CHUNK;
+        int count = 0;
+        if (done < length) {
+            count = (int)(length - done < READ_CHUNK ? length - done : READ_CHUNK);
+        }
+        MPI_File_read_at_all(fh, offset + done, buffer + done, count, MPI_CHAR, MPI_STATUS_IGNORE);
+    }
+}
+
+/*
+ * write length bytes at offset with collective calls, the counterpart of readCollective
+ */
+static void writeCollective(MPI_Comm comm, MPI_File fh, MPI_Offset offset, const char* buffer, MPI_Offset length) {
+    long long rounds = (length + READ_CHUNK - 1) / READ_CHUNK;
+    long long maxRounds;
+    long long round;
+
+    MPI_Allreduce(&rounds, &maxRounds, 1, MPI_LONG_LONG, MPI_MAX, comm);
+    for (round = 0; round < maxRounds; round++) {
+        MPI_Offset done = round * (MPI_Offset)READ_CHUNK;
+        int count = 0;
+        if (done < length) {
+            count = (int)(length - done < READ_CHUNK ? length - done : READ_CHUNK);
+        }
+        MPI_File_write_at_all(fh, offset + done, (char*)buffer + done, count, MPI_CHAR, MPI_STATUS_IGNORE);
+    }
+}
+
+/*
+ * read the complete lines starting in this process's byte range, the
+ * lines are text[begin, end) and text is NUL terminated
+ */
+static char* readOwnedLines(MPI_Comm comm, const char* filename, MPI_Offset* begin, MPI_Offset* end) {
+    int rank, numprocs;
+    MPI_File fh;
+    MPI_Offset fileSize, rangeStart, rangeEnd, readStart, filled, capacity, i;
+    char* text;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numprocs);
+
+    if (MPI_File_open(comm, (char*)filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) {
+            printf("Cannot open file %s\n", filename);
+        }
+        MPI_Abort(comm, 1);
+    }
+    MPI_File_get_size(fh, &fileSize);
+
+    /* the byte range of this process, one byte before it tells whether a line starts at its first byte */
+    rangeStart = fileSize * rank / numprocs;
+    rangeEnd = fileSize * (rank + 1) / numprocs;
+    readStart = rangeStart > 0 ? rangeStart - 1 : 0;
+    filled = rangeEnd - readStart;
+    capacity = filled + TAIL_CHUNK;
+    text = malloc(capacity + 1);
+    readCollective(comm, fh, readStart, text, filled);
+
+    /* the first line starting inside the range */
+    *begin = 0;
+    if (rangeStart > 0) {
+        for (i = 0; i < filled && text[i] != '\n'; i++);
+        *begin = i + 1;
+    }
+
+    if (readStart + *begin >= rangeEnd) {
+        /* no line starts inside the range */
+        *end = *begin = 0;
+    } else {
+        /* the newline ending the line that holds the last byte of the range, the line
+         * may run past the end of the range, so the file is read on until it turns up */
+        i = rangeEnd - readStart - 1;
+        for (;;) {
+            MPI_Offset chunk;
+            /* only the bytes not searched yet */
+            for (; i < filled && text[i] != '\n'; i++);
+            if (i < filled || readStart + filled >= fileSize) {
+                break;
+            }
+            chunk = fileSize - readStart - filled < TAIL_CHUNK ? fileSize - readStart - filled : TAIL_CHUNK;
+            if (filled + chunk > capacity) {
+                capacity *= 2;
+                text = realloc(text, capacity + 1);
+            }
+            MPI_File_read_at(fh, readStart + filled, text + filled, (int)chunk, MPI_CHAR, MPI_STATUS_IGNORE);
+            filled += chunk;
+        }
+        *end = i < filled ? i + 1 : filled;
+        /* nothing after the last line is needed */
+        filled = *end;
+        text = realloc(text, filled + 1);
+    }
+    text[filled] = '\0';
+
+    MPI_File_close(&fh);
+    return text;
+}
+
+/*
+ * the number of lines in text[begin, end), an upper bound of the rows
+ */
+static int countLines(const char* text, MPI_Offset begin, MPI_Offset end) {
+    int lines = 0;
+    MPI_Offset i;
+    for (i = begin; i < end; i++) {
+        if (text[i] == '\n') {
+            lines++;
+        }
+    }
+    return end > begin && text[end - 1] != '\n' ? lines + 1 : lines;
+}
+
+/*
+ * whether a line holds nothing but white space
+ */
+static int blankLine(const char* line, const char* lineEnd) {
+    for (; line < lineEnd; line++) {
+        if (!isspace((unsigned char)*line)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * read this process's share of a 2D file ("x,y" lines), the number of
+ * rows read is stored in rows
+ */
+double* read2DPartition(MPI_Comm comm, const char* filename, int dimension, int* rows) {
+    MPI_Offset begin, end;
+    char* text = readOwnedLines(comm, filename, &begin, &end);
+    double* values = malloc(sizeof(double) * dimension * (size_t)countLines(text, begin, end));
+    char* line = text + begin;
+    int index = 0;
+
+    while (line < text + end) {
+        char* lineEnd = memchr(line, '\n', text + end - line);
+        char* cursor = line;
+        int j;
+        if (lineEnd == NULL) {
+            lineEnd = text + end;
+        }
+        if (!blankLine(line, lineEnd)) {
+            for (j = 0; j < dimension; j++) {
+                char* next;
+                values[(size_t)index * dimension + j] = strtod(cursor, &next);
+                if (next == cursor || next > lineEnd) {
+                    printf("Malformed line in %s: %.*s\n", filename, (int)(lineEnd - line), line);
+                    MPI_Abort(comm, 1);
+                }
+                cursor = next;
+                while (cursor < lineEnd && (*cursor == ',' || isspace((unsigned char)*cursor))) {
+                    cursor++;
+                }
+            }
+            index++;
+        }
+        line = lineEnd + 1;
+    }
+
+    free(text);
+    *rows = index;
+    return values;
+}
+
+/*
+ * read this process's share of a DNA file (comma separated bases) and
+ * pack every strand, the number of rows read is stored in rows
+ */
+uint64_t* readDNAPartition(MPI_Comm comm, const char* filename, int dimension, int* rows) {
+    MPI_Offset begin, end;
+    char* text = readOwnedLines(comm, filename, &begin, &end);
+    int words = packedWords(dimension);
+    uint64_t* packed = malloc(sizeof(uint64_t) * words * (size_t)countLines(text, begin, end));
+    char* strand = malloc(dimension);
+    char* line = text + begin;
+    int index = 0;
+
+    while (line < text + end) {
+        char* lineEnd = memchr(line, '\n', text + end - line);
+        char* cursor;
+        int bases = 0;
+        if (lineEnd == NULL) {
+            lineEnd = text + end;
+        }
+        if (!blankLine(line, lineEnd)) {
+            /* every letter on the line is a base, the commas are skipped */
+            for (cursor = line; cursor < lineEnd; cursor++) {
+                if (isalpha((unsigned char)*cursor)) {
+                    if (bases < dimension) {
+                        strand[bases] = *cursor;
+                    }
+                    bases++;
+                }
+            }
+            if (bases != dimension) {
+                printf("Strand of %d bases instead of %d in %s\n", bases, dimension, filename);
+                MPI_Abort(comm, 1);
+            }
+            packDNA(strand, packed + (size_t)index * words, dimension);
+            index++;
+        }
+        line = lineEnd + 1;
+    }
+
+    free(strand);
+    free(text);
+    *rows = index;
+    return packed;
+}
+
+/*
+ * read this process's share of a DNA file whose strands may differ in
+ * length into an arena, see dnaedit.h
+ */
+StrandArena* readStrandPartition(MPI_Comm comm, const char* filename) {
+    MPI_Offset begin, end;
+    char* text = readOwnedLines(comm, filename, &begin, &end);
+    StrandArena* strands = createStrandArena();
+    int capacity = 256;
+    char* strand = malloc(capacity);
+    char* line = text + begin;
+
+    while (line < text + end) {
+        char* lineEnd = memchr(line, '\n', text + end - line);
+        char* cursor;
+        int bases = 0;
+        if (lineEnd == NULL) {
+            lineEnd = text + end;
+        }
+        if (!blankLine(line, lineEnd)) {
+            /* every letter on the line is a base, the commas are skipped */
+            for (cursor = line; cursor < lineEnd; cursor++) {
+                if (isalpha((unsigned char)*cursor)) {
+                    if (bases == capacity) {
+                        capacity *= 2;
+                        strand = realloc(strand, capacity);
+                    }
+                    strand[bases++] = *cursor;
+                }
+            }
+            appendStrand(strands, strand, bases);
+        }
+        line = lineEnd + 1;
+    }
+
+    free(strand);
+    free(text);
+    return strands;
+}
+
+/*
+ * map count rows of a binary data set from global row firstRow on and copy them into values
+ */
+static void mapRows(MPI_Comm comm, const char* filename, int firstRow, int count, int rowBytes, void* values) {
+    size_t length = (size_t)count * rowBytes;
+    size_t pageOffset;
+    off_t offset;
+    void* mapped;
+    int fd;
+
+    if (length == 0) {
+        return;
+    }
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        printf("Cannot open file %s\n", filename);
+        MPI_Abort(comm, 1);
+    }
+    /* the mapping has to start on a page boundary */
+    offset = (off_t)sizeof(DatasetHeader) + (off_t)firstRow * rowBytes;
+    pageOffset = (size_t)(offset % sysconf(_SC_PAGESIZE));
+    mapped = mmap(NULL, length + pageOffset, PROT_READ, MAP_PRIVATE, fd, offset - pageOffset);
+    if (mapped == MAP_FAILED) {
+        printf("Cannot map file %s\n", filename);
+        MPI_Abort(comm, 1);
+    }
+    madvise(mapped, length + pageOffset, MADV_SEQUENTIAL);
+    memcpy(values, (char*)mapped + pageOffset, length);
+    munmap(mapped, length + pageOffset);
+    close(fd);
+}
+
+/*
+ * map this process's rows of a binary data set and copy them into a new
+ * buffer, the number of rows is stored in rows
+ */
+void* readBinaryPartition(MPI_Comm comm, const char* filename, const DatasetHeader* header, int* rows) {
+    int rank, numprocs, firstRow;
+    int rowBytes = datasetRowBytes(header);
+    size_t length;
+    void* values;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numprocs);
+    partitionRows((int)header->rows, numprocs, rank, &firstRow, rows);
+
+    length = (size_t)*rows * rowBytes;
+    values = malloc(length > 0 ? length : 1);
+    mapRows(comm, filename, firstRow, *rows, rowBytes, values);
+    return values;
+}
+
+/*
+ * this process's rows of a binary data set in a window shared by the
+ * processes of its node: the first process of the node copies in the rows
+ * of all of them, the others only wait for it. Returns the rows of this
+ * process inside the window, which are read only and freed with
+ * MPI_Win_free on window. The number of rows is stored in rows.
+ */
+void* readSharedPartition(MPI_Comm comm, const char* filename, const DatasetHeader* header, int* rows,
+                          MPI_Win* window) {
+    int rank, numprocs, firstRow;
+    int nodeRank, nodeSize;
+    int rowBytes = datasetRowBytes(header);
+    int share[2];
+    int* shares = NULL;
+    MPI_Comm node;
+    void* values;
+    int r, next;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numprocs);
+    partitionRows((int)header->rows, numprocs, rank, &firstRow, rows);
+
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+    MPI_Comm_rank(node, &nodeRank);
+    MPI_Comm_size(node, &nodeSize);
+    /* every process owns the segment of its rows, the segments of a node follow each other */
+    MPI_Win_allocate_shared((MPI_Aint)*rows * rowBytes, 1, MPI_INFO_NULL, node, &values, window);
+
+    share[0] = firstRow;
+    share[1] = *rows;
+    if (nodeRank == 0) {
+        shares = malloc(sizeof(int) * 2 * nodeSize);
+    }
+    MPI_Gather(share, 2, MPI_INT, shares, 2, MPI_INT, 0, node);
+
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, *window);
+    if (nodeRank == 0) {
+        for (r = 0; r < nodeSize; r = next) {
+            MPI_Aint size;
+            int unit;
+            char* start;
+            char* segment;
+            int count = shares[2 * r + 1];
+
+            MPI_Win_shared_query(*window, r, &size, &unit, &start);
+            /* the processes whose rows follow each other in the file and in the window are copied in one go,
+             * which is all of the node when it runs consecutive ranks */
+            for (next = r + 1; next < nodeSize && shares[2 * next] == shares[2 * r] + count; next++) {
+                MPI_Win_shared_query(*window, next, &size, &unit, &segment);
+                if (segment != start + (size_t)count * rowBytes) {
+                    break;
+                }
+                count += shares[2 * next + 1];
+            }
+            mapRows(comm, filename, shares[2 * r], count, rowBytes, start);
+        }
+        free(shares);
+    }
+    /* the rows are in place before any process of the node reads them */
+    MPI_Win_sync(*window);
+    MPI_Barrier(node);
+    MPI_Win_sync(*window);
+    MPI_Win_unlock_all(*window);
+
+    MPI_Comm_free(&node);
+    return values;
+}
+
+/*
+ * free the rows of readBinaryPartition, or with window set those of readSharedPartition
+ */
+void freePartition(void* rows, MPI_Win* window) {
+    if (*window != MPI_WIN_NULL) {
+        MPI_Win_free(window);
+    } else {
+        free(rows);
+    }
+}
+
+/*
+ * narrow count doubles to floats in place and shrink the buffer to them.
+ * Float i only overwrites doubles before double i, which are already read.
+ */
+float* narrowRows(double* rows, size_t count) {
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        double value;
+        float narrow;
+        memcpy(&value, (char*)rows + i * sizeof(double), sizeof(double));
+        narrow = (float)value;
+        memcpy((char*)rows + i * sizeof(float), &narrow, sizeof(float));
+    }
+    return realloc(rows, count > 0 ? count * sizeof(float) : 1);
+}
+
+/*
+ * widen count floats into result
+ */
+void widenRows(const float* rows, size_t count, double* result) {
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        result[i] = rows[i];
+    }
+}
+
+/*
+ * collect the rows with the given global indices from the processes
+ * owning them into result on root. rows holds the localRows rows of this
+ * process starting at global index firstRow, each rowBytes long.
+ */
+void fetchRows(MPI_Comm comm, int root, const int* indices, int count,
+               const void* rows, int firstRow, int localRows, int rowBytes, void* result) {
+    /* every process fills the rows it owns and leaves the others zero, so OR-ing the buffers merges them */
+    unsigned char* contribution = calloc((size_t)count * rowBytes, 1);
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (indices[i] >= firstRow && indices[i] < firstRow + localRows) {
+            memcpy(contribution + (size_t)i * rowBytes, (const unsigned char*)rows + (size_t)(indices[i] - firstRow) * rowBytes, rowBytes);
+        }
+    }
+    MPI_Reduce(contribution, result, count * rowBytes, MPI_BYTE, MPI_BOR, root, comm);
+    free(contribution);
+}
+
+/*
+ * write the labels of the localRows rows of this process into filename
+ * with collective MPI-IO, after those of the processes of lower rank.
+ * LABELS_TEXT writes one label per line, LABELS_BINARY native ints.
+ */
+void writeLabels(MPI_Comm comm, const char* filename, int format, const int* categories, int localRows) {
+    int rank;
+    MPI_File fh;
+    char* text = NULL;
+    const char* bytes;
+    long long length = 0;
+    long long offset = 0;
+    int i;
+
+    MPI_Comm_rank(comm, &rank);
+    if (format == LABELS_TEXT) {
+        /* an int takes at most 11 characters and the newline */
+        text = malloc((size_t)localRows * 12 + 1);
+        for (i = 0; i < localRows; i++) {
+            length += sprintf(text + length, "%d\n", categories[i]);
+        }
+        bytes = text;
+    } else {
+        length = (long long)localRows * sizeof(int);
+        bytes = (const char*)categories;
+    }
+
+    /* the text lines differ in length, so every process learns where its own start from the ones before */
+    MPI_Exscan(&length, &offset, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) {
+        offset = 0;
+    }
+
+    if (MPI_File_open(comm, (char*)filename, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) {
+            printf("Cannot create file %s\n", filename);
+        }
+        MPI_Abort(comm, 1);
+    }
+    /* a shorter run must not leave labels of an earlier one behind */
+    MPI_File_set_size(fh, 0);
+    writeCollective(comm, fh, offset, bytes, length);
+    MPI_File_close(&fh);
+    free(text);
+}
+
+/*
+ * write the centroids as "x,y" lines, the format of a 2D input file
+ */
+void write2DCentroids(const char* filename, const double* centroids, int cluster, int dimension) {
+    FILE* file = fopen(filename, "w");
+    int i, j;
+
+    if (file == NULL) {
+        printf("Cannot create file %s\n", filename);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (i = 0; i < cluster; i++) {
+        for (j = 0; j < dimension; j++) {
+            /* enough digits to read back the same double */
+            fprintf(file, j == 0 ? "%.17g" : ",%.17g", centroids[i * dimension + j]);
+        }
+        fprintf(file, "\n");
+    }
+    fclose(file);
+}
+
+/*
+ * write the packed centroids as comma separated bases, the format of a DNA input file
+ */
+void writeDNACentroids(const char* filename, const uint64_t* centroids, int cluster, int dimension) {
+    FILE* file = fopen(filename, "w");
+    int words = packedWords(dimension);
+    char* strand = malloc(dimension);
+    int i, j;
+
+    if (file == NULL) {
+        printf("Cannot create file %s\n", filename);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (i = 0; i < cluster; i++) {
+        unpackDNA(centroids + (size_t)i * words, strand, dimension);
+        for (j = 0; j < dimension; j++) {
+            fprintf(file, j == 0 ? "%c" : ",%c", strand[j]);
+        }
+        fprintf(file, "\n");
+    }
+    fclose(file);
+    free(strand);
+}
+
+/*
+ * write the strands of an arena as comma separated bases, one per line
+ */
+void writeStrands(const char* filename, const StrandArena* strands) {
+    FILE* file = fopen(filename, "w");
+    int i, j;
+
+    if (file == NULL) {
+        printf("Cannot create file %s\n", filename);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (i = 0; i < strands->count; i++) {
+        const uint64_t* strand = arenaStrand(strands, i);
+        for (j = 0; j < strands->lengths[i]; j++) {
+            fprintf(file, j == 0 ? "%c" : ",%c", "ACGT"[packedBase(strand, j)]);
+        }
+        fprintf(file, "\n");
+    }
+    fclose(file);
+}
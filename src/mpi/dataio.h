@@ -0,0 +1,94 @@
+#ifndef _DATAIO_H_
+#define _DATAIO_H_
+
+#include <stdint.h>
+#include "mpi.h"
+#include "dataset.h"
+#include "dnaedit.h"
+
+/*
+ * Every process of the communicator reads its own byte range of a text file
+ * with MPI-IO. A line belongs to the process whose range holds its first
+ * byte, so the partial lines at the range boundaries are completed by
+ * reading past the end of the range. Blank lines are skipped.
+ */
+
+/*
+ * read this process's share of a 2D file ("x,y" lines), the number of
+ * rows read is stored in rows
+ */
+double* read2DPartition(MPI_Comm comm, const char* filename, int dimension, int* rows);
+
+/*
+ * read this process's share of a DNA file (comma separated bases) and
+ * pack every strand, the number of rows read is stored in rows
+ */
+uint64_t* readDNAPartition(MPI_Comm comm, const char* filename, int dimension, int* rows);
+
+/*
+ * read this process's share of a DNA file whose strands may differ in
+ * length into an arena, see dnaedit.h
+ */
+StrandArena* readStrandPartition(MPI_Comm comm, const char* filename);
+
+/*
+ * map this process's rows of a binary data set and copy them into a new
+ * buffer, the number of rows is stored in rows
+ */
+void* readBinaryPartition(MPI_Comm comm, const char* filename, const DatasetHeader* header, int* rows);
+
+/*
+ * this process's rows of a binary data set in a window of
+ * MPI_Win_allocate_shared shared by the processes of its node, copied in
+ * once by the first process of the node. The rows are read only and freed
+ * with MPI_Win_free on window, the number of them is stored in rows.
+ */
+void* readSharedPartition(MPI_Comm comm, const char* filename, const DatasetHeader* header, int* rows,
+                          MPI_Win* window);
+
+/*
+ * free the rows of readBinaryPartition, or with window set those of readSharedPartition
+ */
+void freePartition(void* rows, MPI_Win* window);
+
+/*
+ * narrow count doubles to floats in place and shrink the buffer to them
+ */
+float* narrowRows(double* rows, size_t count);
+
+/*
+ * widen count floats into result
+ */
+void widenRows(const float* rows, size_t count, double* result);
+
+/*
+ * collect the rows with the given global indices from the processes
+ * owning them into result on root. rows holds the localRows rows of this
+ * process starting at global index firstRow, each rowBytes long.
+ */
+void fetchRows(MPI_Comm comm, int root, const int* indices, int count,
+               const void* rows, int firstRow, int localRows, int rowBytes, void* result);
+
+/*
+ * write the labels of the localRows rows of this process into filename
+ * with collective MPI-IO, after those of the processes of lower rank.
+ * LABELS_TEXT writes one label per line, LABELS_BINARY native ints.
+ */
+void writeLabels(MPI_Comm comm, const char* filename, int format, const int* categories, int localRows);
+
+/*
+ * write the centroids as "x,y" lines, the format of a 2D input file
+ */
+void write2DCentroids(const char* filename, const double* centroids, int cluster, int dimension);
+
+/*
+ * write the packed centroids as comma separated bases, the format of a DNA input file
+ */
+void writeDNACentroids(const char* filename, const uint64_t* centroids, int cluster, int dimension);
+
+/*
+ * write the strands of an arena as comma separated bases, one per line
+ */
+void writeStrands(const char* filename, const StrandArena* strands);
+
+#endif
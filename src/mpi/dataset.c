@@ -0,0 +1,65 @@
+#include <string.h>
+#include "dataset.h"
+#include "dnapack.h"
+
+/*
+ * read the header of a file, returns 1 if it is a binary data set
+ */
+int readDatasetHeader(const char* filename, DatasetHeader* header) {
+    FILE* file = fopen(filename, "rb");
+    int binary = 0;
+
+    if (file == NULL) {
+        return 0;
+    }
+    if (fread(header, sizeof(DatasetHeader), 1, file) == 1
+        && memcmp(header->magic, DATASET_MAGIC, 4) == 0) {
+        binary = 1;
+    }
+    fclose(file);
+    return binary;
+}
+
+/*
+ * write a header of the given type at the start of an open file
+ */
+void writeDatasetHeader(FILE* file, int elementType, int dimension, int64_t rows) {
+    DatasetHeader header;
+
+    memset(&header, 0, sizeof(DatasetHeader));
+    memcpy(header.magic, DATASET_MAGIC, 4);
+    header.version = DATASET_VERSION;
+    header.elementType = elementType;
+    header.dimension = dimension;
+    header.rows = rows;
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(DatasetHeader), 1, file);
+}
+
+/*
+ * the number of bytes of one row
+ */
+int datasetRowBytes(const DatasetHeader* header) {
+    switch (header->elementType) {
+        case DATASET_FLOAT64:
+            return (int)sizeof(double) * header->dimension;
+        case DATASET_DNA2BIT:
+            return (int)sizeof(uint64_t) * packedWords(header->dimension);
+        default:
+            return 0;
+    }
+}
+
+/*
+ * the name of an element type
+ */
+const char* datasetTypeName(int elementType) {
+    switch (elementType) {
+        case DATASET_FLOAT64:
+            return "float64";
+        case DATASET_DNA2BIT:
+            return "dna2bit";
+        default:
+            return "unknown";
+    }
+}
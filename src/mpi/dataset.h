@@ -0,0 +1,51 @@
+#ifndef _DATASET_H_
+#define _DATASET_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Binary data set layout: a DatasetHeader followed by the rows, each row
+ * holding rowBytes bytes. 2D points are stored as doubles, DNA strands
+ * are stored packed at 2 bits per base (see dnapack.h).
+ */
+
+/* the first bytes of every binary data set */
+#define DATASET_MAGIC "KMDS"
+/* the version written by this code */
+#define DATASET_VERSION 1
+
+/* the element types */
+#define DATASET_FLOAT64 1
+#define DATASET_DNA2BIT 2
+
+typedef struct {
+    char magic[4];
+    int32_t version;
+    int32_t elementType;
+    int32_t dimension;
+    int64_t rows;
+    int64_t reserved;
+} DatasetHeader;
+
+/*
+ * read the header of a file, returns 1 if it is a binary data set
+ */
+int readDatasetHeader(const char* filename, DatasetHeader* header);
+
+/*
+ * write a header of the given type at the start of an open file
+ */
+void writeDatasetHeader(FILE* file, int elementType, int dimension, int64_t rows);
+
+/*
+ * the number of bytes of one row
+ */
+int datasetRowBytes(const DatasetHeader* header);
+
+/*
+ * the name of an element type
+ */
+const char* datasetTypeName(int elementType);
+
+#endif
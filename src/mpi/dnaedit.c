@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <string.h>
+#include "dnaedit.h"
+
+/* the bottom row of a block */
+#define HIGH_BIT (1ULL << (EDIT_BLOCK_BASES - 1))
+
+StrandArena* createStrandArena(void) {
+    StrandArena* arena = malloc(sizeof(StrandArena));
+    arena->count = 0;
+    arena->capacity = 64;
+    arena->wordCount = 0;
+    arena->wordCapacity = 256;
+    arena->words = malloc(sizeof(uint64_t) * arena->wordCapacity);
+    arena->offsets = malloc(sizeof(long long) * (arena->capacity + 1));
+    arena->lengths = malloc(sizeof(int) * arena->capacity);
+    arena->offsets[0] = 0;
+    return arena;
+}
+
+/*
+ * make room for one more strand of words words, returns where it goes
+ */
+static uint64_t* reserveStrand(StrandArena* arena, int length, int words) {
+    if (arena->count == arena->capacity) {
+        arena->capacity *= 2;
+        arena->offsets = realloc(arena->offsets, sizeof(long long) * (arena->capacity + 1));
+        arena->lengths = realloc(arena->lengths, sizeof(int) * arena->capacity);
+    }
+    while (arena->wordCount + words > arena->wordCapacity) {
+        arena->wordCapacity *= 2;
+        arena->words = realloc(arena->words, sizeof(uint64_t) * arena->wordCapacity);
+    }
+    arena->lengths[arena->count] = length;
+    arena->wordCount += words;
+    arena->offsets[++arena->count] = arena->wordCount;
+    return arena->words + arena->wordCount - words;
+}
+
+/*
+ * append a strand of characters
+ */
+void appendStrand(StrandArena* arena, const char* bases, int length) {
+    packDNA(bases, reserveStrand(arena, length, packedWords(length)), length);
+}
+
+/*
+ * append a packed strand of length bases
+ */
+void appendPackedStrand(StrandArena* arena, const uint64_t* packed, int length) {
+    int words = packedWords(length);
+    memcpy(reserveStrand(arena, length, words), packed, sizeof(uint64_t) * words);
+}
+
+void freeStrandArena(StrandArena* arena) {
+    free(arena->words);
+    free(arena->offsets);
+    free(arena->lengths);
+    free(arena);
+}
+
+void prepareEditPattern(EditPattern* pattern, const uint64_t* packed, int length) {
+    int i;
+    pattern->length = length;
+    pattern->blocks = (length + EDIT_BLOCK_BASES - 1) / EDIT_BLOCK_BASES;
+    pattern->peq = calloc((size_t)(pattern->blocks > 0 ? pattern->blocks : 1) * 4, sizeof(uint64_t));
+    for (i = 0; i < length; i++) {
+        pattern->peq[(i / EDIT_BLOCK_BASES) * 4 + packedBase(packed, i)] |= 1ULL << (i % EDIT_BLOCK_BASES);
+    }
+}
+
+void freeEditPattern(EditPattern* pattern) {
+    free(pattern->peq);
+}
+
+/*
+ * advance one block of the column by one text base: pv and mv are the
+ * vertical +1 and -1 deltas of the block, eq the positions matching the
+ * base and hin the horizontal delta entering at the top. Returns the
+ * horizontal delta leaving at the bottom.
+ */
+static inline int advanceBlock(uint64_t* pv, uint64_t* mv, uint64_t eq, int hin) {
+    uint64_t hinNegative = hin < 0;
+    uint64_t xv = eq | *mv;
+    uint64_t xh, ph, mh;
+    int hout;
+
+    eq |= hinNegative;
+    xh = (((eq & *pv) + *pv) ^ *pv) | eq;
+    ph = *mv | ~(xh | *pv);
+    mh = *pv & xh;
+    hout = (ph & HIGH_BIT) ? 1 : ((mh & HIGH_BIT) ? -1 : 0);
+    ph = (ph << 1) | (uint64_t)(hin > 0);
+    mh = (mh << 1) | hinNegative;
+    *pv = mh | ~(xv | ph);
+    *mv = ph & xv;
+    return hout;
+}
+
+/*
+ * the edit distance between pattern and the packed text of length bases
+ * when it is at most limit, limit + 1 otherwise. scratch holds
+ * 3 * pattern->blocks words.
+ */
+int editDistance(const EditPattern* pattern, const uint64_t* text, int length, int limit, uint64_t* scratch) {
+    int m = pattern->length;
+    int n = length;
+    int blocks = pattern->blocks;
+    uint64_t* pv = scratch;
+    uint64_t* mv = scratch + blocks;
+    long long* score = (long long*)(scratch + 2 * blocks);
+    /* the rows of the last block past the end of the pattern */
+    uint64_t padding = m % EDIT_BLOCK_BASES != 0 ? ~0ULL << (m % EDIT_BLOCK_BASES) : 0;
+    int difference = m - n;
+    int slack, below, above;
+    int first = 0;
+    int last = -1;
+    long long distance = m;
+    int j, b;
+
+    if (limit > m + n) {
+        limit = m + n;
+    }
+    if ((difference < 0 ? -difference : difference) > limit) {
+        return limit + 1;
+    }
+    if (m == 0) {
+        return n;
+    }
+
+    /* a path of at most limit edits stays on the diagonals row - column in [below, above] */
+    slack = (limit - (difference < 0 ? -difference : difference)) / 2;
+    below = (difference < 0 ? difference : 0) - slack;
+    above = (difference > 0 ? difference : 0) + slack;
+
+    for (j = 1; j <= n; j++) {
+        const uint64_t* peq = pattern->peq + packedBase(text, j - 1);
+        int lastWanted = j + above >= m ? blocks - 1 : (j + above - 1) / EDIT_BLOCK_BASES;
+        int firstWanted = j + below <= 1 ? 0 : (j + below - 1) / EDIT_BLOCK_BASES;
+        /* the top row grows by one per column, so does the row above a skipped block */
+        int hout = 1;
+
+        /* a block entering the band starts from an upper bound: one more per row than the row above */
+        while (last < lastWanted) {
+            last++;
+            pv[last] = ~0ULL;
+            mv[last] = 0;
+            score[last] = (last == 0 ? j - 1 : score[last - 1]) + EDIT_BLOCK_BASES;
+        }
+        first = firstWanted > first ? firstWanted : first;
+
+        for (b = first; b <= last; b++) {
+            hout = advanceBlock(&pv[b], &mv[b], peq[4 * b], hout);
+            score[b] += hout;
+        }
+
+        if (last == blocks - 1) {
+            /* the bottom row of the pattern, and at best one less per column left */
+            distance = score[last] - __builtin_popcountll(pv[last] & padding) + __builtin_popcountll(mv[last] & padding);
+            if (distance - (n - j) > limit) {
+                return limit + 1;
+            }
+        }
+    }
+    return distance <= limit ? (int)distance : limit + 1;
+}
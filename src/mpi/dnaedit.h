@@ -0,0 +1,76 @@
+#ifndef _DNAEDIT_H_
+#define _DNAEDIT_H_
+
+#include <stdint.h>
+#include "dnapack.h"
+
+/*
+ * Strands of any length and the edit (Levenshtein) distance between them.
+ * The strands of a process are packed at 2 bits per base as in dnapack.h,
+ * one after the other in a single arena, and found through their offsets.
+ * The distance is the bit-parallel algorithm of Myers in the block form of
+ * Hyyrö: the pattern is cut into blocks of 64 bases, every column of the
+ * dynamic programming matrix takes a few word operations per block. Given
+ * a limit the blocks outside the diagonals a path of at most limit edits
+ * can take are skipped (Ukkonen's band), and the computation stops once
+ * the limit cannot be met any more.
+ */
+
+/* the bases of one pattern block */
+#define EDIT_BLOCK_BASES 64
+
+/*
+ * the strands of one process
+ */
+typedef struct {
+    int count;
+    int capacity;
+    /* the packed bases, offsets[i] is the first word of strand i */
+    uint64_t* words;
+    long long wordCount;
+    long long wordCapacity;
+    long long* offsets;
+    /* the number of bases of every strand */
+    int* lengths;
+} StrandArena;
+
+StrandArena* createStrandArena(void);
+
+/*
+ * append a strand of characters
+ */
+void appendStrand(StrandArena* arena, const char* bases, int length);
+
+/*
+ * append a packed strand of length bases
+ */
+void appendPackedStrand(StrandArena* arena, const uint64_t* packed, int length);
+
+static inline const uint64_t* arenaStrand(const StrandArena* arena, int index) {
+    return arena->words + arena->offsets[index];
+}
+
+void freeStrandArena(StrandArena* arena);
+
+/*
+ * a strand prepared to be compared against others: for every block and
+ * base code the bits of the positions holding that base
+ */
+typedef struct {
+    int length;
+    int blocks;
+    uint64_t* peq;
+} EditPattern;
+
+void prepareEditPattern(EditPattern* pattern, const uint64_t* packed, int length);
+
+void freeEditPattern(EditPattern* pattern);
+
+/*
+ * the edit distance between pattern and the packed text of length bases
+ * when it is at most limit, limit + 1 otherwise. scratch holds
+ * 3 * pattern->blocks words.
+ */
+int editDistance(const EditPattern* pattern, const uint64_t* text, int length, int limit, uint64_t* scratch);
+
+#endif
@@ -0,0 +1,732 @@
+#include <stdlib.h>
+#include <string.h>
+#include "dnakmeans.h"
+#include "dnapack.h"
+#include "bounds.h"
+#include "threadpool.h"
+#include "timing.h"
+#include "rebalance.h"
+
+/*
+ * mini-batch k-means: every process samples options->miniBatch of its
+ * strands per iteration. The batch base counts are added to counts kept
+ * since the start, so the weight of a batch in the consensus of a centroid
+ * is the number of its members over the number of strands the centroid has
+ * seen. Returns the number of iterations.
+ */
+static int dnaMiniBatch(MPI_Comm comm, const uint64_t* rows, int localRows, int dimension, int cluster,
+                        const KMeansOptions* options, uint64_t* centroids, int* categories) {
+    int i, j;
+    int rank;
+    int iterations = 0;
+    int words = packedWords(dimension);
+    unsigned int seed;
+
+    int* batchContents = malloc(sizeof(int) * cluster * dimension * 4);
+    int* distributedContents = malloc(sizeof(int) * cluster * dimension * 4);
+    /* the base counts of every strand the centroids have seen, the same on every process */
+    int* seenContents = calloc(cluster * dimension * 4, sizeof(int));
+    uint64_t* centroid = malloc(sizeof(uint64_t) * words);
+
+    MPI_Comm_rank(comm, &rank);
+    seed = 1 + rank;
+
+    for (i = 0; i < localRows; i++) {
+        categories[i] = -1;
+    }
+
+    do {
+        int sumDistance = 0;
+
+        memset(batchContents, 0, sizeof(int) * cluster * dimension * 4);
+        iterations++;
+        nextIteration();
+
+        /* assign and count a random batch of the local strands */
+        beginPhase(PHASE_ASSIGN);
+        for (i = 0; localRows > 0 && i < options->miniBatch; i++) {
+            int row = rand_r(&seed) % localRows;
+            const uint64_t* strand = rows + (size_t)row * words;
+            int category = nearestPackedCentroid(strand, centroids, cluster, words, NULL);
+            int* counts = batchContents + 4 * dimension * category;
+            categories[row] = category;
+            for (j = 0; j < dimension; j++) {
+                counts[4 * j + packedBase(strand, j)]++;
+            }
+        }
+        endPhase(PHASE_ASSIGN);
+        addDistances(localRows > 0 ? (long long)options->miniBatch * cluster : 0);
+
+        beginPhase(PHASE_REDUCE);
+        MPI_Allreduce(batchContents, distributedContents, cluster * 4 * dimension, MPI_INT, MPI_SUM, comm);
+        endPhase(PHASE_REDUCE);
+
+        beginPhase(PHASE_UPDATE);
+        for (i = 0; i < cluster * dimension * 4; i++) {
+            seenContents[i] += distributedContents[i];
+        }
+        for (i = 0; i < cluster; i++) {
+            if (packedConsensus(seenContents + i * dimension * 4, centroid, dimension) == 0) {
+                continue;
+            }
+            sumDistance += packedDNADistance(centroid, centroids + i * words, words);
+            memcpy(centroids + i * words, centroid, sizeof(uint64_t) * words);
+        }
+        endPhase(PHASE_UPDATE);
+
+        if (sumDistance <= DNA_DIFF_THRESHOLD) {
+            break;
+        }
+    } while (iterations < options->maxIterations);
+    endIterations();
+
+    /* one full assignment so that every strand has a category */
+    if (options->finalPass) {
+        beginPhase(PHASE_ASSIGN);
+        for (i = 0; i < localRows; i++) {
+            categories[i] = nearestPackedCentroid(rows + (size_t)i * words, centroids, cluster, words, NULL);
+        }
+        endPhase(PHASE_ASSIGN);
+        addDistances((long long)localRows * cluster);
+    }
+
+    free(batchContents);
+    free(distributedContents);
+    free(seenContents);
+    free(centroid);
+    return iterations;
+}
+
+/*
+ * the state one iteration shares between the threads of a process
+ */
+typedef struct {
+    const uint64_t* rows;
+    int localRows;
+    int dimension;
+    int words;
+    int cluster;
+    int prune;
+    /* the first iteration sets the bounds, the later ones first loosen them by drift */
+    int first;
+    const uint64_t* centroids;
+    const int* drift;
+    const int* centroidDistances;
+    const int* separation;
+    int* categories;
+    int* upper;
+    int* lower;
+    /* one block of base counts per thread, stride ints apart */
+    int* accumulators;
+    int stride;
+    /* what every thread did in the last pass */
+    ThreadTimes* times;
+    /* with --delta the category each strand was last counted under, -1 for none, NULL without */
+    int* previous;
+    /* the bit-sliced counters of every thread, the strands added and, with --delta, the ones removed */
+    BaseCounter** counters;
+} DNAStep;
+
+/*
+ * assign the strands of one thread and count their bases in its own accumulators
+ */
+static void dnaStep(void* arg, int thread, int threads) {
+    DNAStep* step = arg;
+    int dimension = step->dimension;
+    int words = step->words;
+    int* contents = step->accumulators + (size_t)thread * step->stride;
+    ThreadTimes* times = step->times + thread;
+    double start = timerNow();
+    double assigned;
+    BaseCounter* added;
+    int begin, end;
+    int i;
+
+    threadRows(step->localRows, thread, threads, &begin, &end);
+
+    /* Calculate each points distances to centroids and categorize it */
+    if (step->prune == PRUNE_NONE) {
+        for (i = begin; i < end; i++) {
+            step->categories[i] = nearestPackedCentroid(step->rows + (size_t)i * words, step->centroids,
+                                                        step->cluster, words, NULL);
+        }
+        times->distances = (long long)(end - begin) * step->cluster;
+    } else if (step->first) {
+        times->distances = initDNABounds(step->prune, step->rows, begin, end, words, step->centroids,
+                                         step->cluster, step->categories, step->upper, step->lower);
+    } else {
+        /* the bounds follow the consensus changes */
+        shiftDNABounds(step->prune, begin, end, step->cluster, step->drift, step->categories,
+                       step->upper, step->lower);
+        times->distances = boundedDNAAssign(step->prune, step->rows, begin, end, words, step->centroids,
+                                            step->cluster, step->centroidDistances, step->separation,
+                                            step->categories, step->upper, step->lower);
+    }
+    assigned = timerNow();
+    times->assign = assigned - start;
+
+    /* Work for each Line's base code and update the array's value */
+    memset(contents, 0, sizeof(int) * step->stride);
+    added = step->counters[2 * thread];
+    resetBaseCounter(added, contents, 1);
+    if (step->previous != NULL) {
+        /* only the strands that changed cluster move their bases from one count to the other,
+         * and the number of them follows the counts */
+        BaseCounter* removed = step->counters[2 * thread + 1];
+        resetBaseCounter(removed, contents, -1);
+        for (i = begin; i < end; i++) {
+            int before = step->previous[i];
+            if (step->categories[i] == before) {
+                continue;
+            }
+            countStrand(added, step->categories[i], step->rows + (size_t)i * words);
+            if (before >= 0) {
+                countStrand(removed, before, step->rows + (size_t)i * words);
+            }
+            contents[4 * dimension * step->cluster]++;
+            step->previous[i] = step->categories[i];
+        }
+        flushBaseCounter(removed);
+    } else {
+        for (i = begin; i < end; i++) {
+            countStrand(added, step->categories[i], step->rows + (size_t)i * words);
+        }
+    }
+    flushBaseCounter(added);
+    times->accumulate = timerNow() - assigned;
+}
+
+/*
+ * the bit-sliced counters of threads threads, two per thread of which the
+ * second, for the strands removed by --delta, only exists with delta set
+ */
+static BaseCounter** createThreadCounters(int threads, int cluster, int dimension, int delta) {
+    BaseCounter** counters = malloc(sizeof(BaseCounter*) * 2 * threads);
+    int t;
+
+    for (t = 0; t < threads; t++) {
+        counters[2 * t] = createBaseCounter(cluster, dimension);
+        counters[2 * t + 1] = delta ? createBaseCounter(cluster, dimension) : NULL;
+    }
+    return counters;
+}
+
+static void freeThreadCounters(BaseCounter** counters, int threads) {
+    int t;
+
+    for (t = 0; t < 2 * threads; t++) {
+        if (counters[t] != NULL) {
+            freeBaseCounter(counters[t]);
+        }
+    }
+    free(counters);
+}
+
+/*
+ * one assignment pass in blocks of strands: the counts of each block go
+ * out with MPI_Iallreduce while the threads assign the next block, and the
+ * reduced blocks are added up into distributedContents at the end. With
+ * sliceCounts every process only gets resultLength counts of the clusters
+ * it owns, through MPI_Ireduce_scatter. Returns how long the threads took
+ * over all blocks.
+ */
+static double pipelinedDNAPass(MPI_Comm comm, ThreadPool* pool, const DNAStep* step, int blocks, int lowerPerRow,
+                             int payload, const int* sliceCounts, int resultLength, int* blockContents,
+                             int* blockResults, MPI_Request* requests, int* distributedContents) {
+    int threads = poolThreads(pool);
+    double busy = 0;
+    int b, t, i;
+    int done;
+
+    for (b = 0; b < blocks; b++) {
+        DNAStep block = *step;
+        int* contents = blockContents + (size_t)b * payload;
+        int begin, end;
+
+        threadRows(step->localRows, b, blocks, &begin, &end);
+        block.rows = step->rows + (size_t)begin * step->words;
+        block.localRows = end - begin;
+        block.categories = step->categories + begin;
+        if (step->previous != NULL) {
+            block.previous = step->previous + begin;
+        }
+        if (step->upper != NULL) {
+            block.upper = step->upper + begin;
+            block.lower = step->lower + (size_t)begin * lowerPerRow;
+        }
+        runThreadPool(pool, dnaStep, &block);
+        busy += recordThreadTimes(step->times, threads);
+
+        beginPhase(PHASE_ACCUMULATE);
+        memcpy(contents, step->accumulators, sizeof(int) * payload);
+        for (t = 1; t < threads; t++) {
+            const int* thread = step->accumulators + (size_t)t * step->stride;
+            for (i = 0; i < payload; i++) {
+                contents[i] += thread[i];
+            }
+        }
+        endPhase(PHASE_ACCUMULATE);
+        /* every process posts the same number of blocks, empty ones included */
+        beginPhase(PHASE_REDUCE);
+        if (sliceCounts != NULL) {
+            MPI_Ireduce_scatter(contents, blockResults + (size_t)b * resultLength, sliceCounts, MPI_INT, MPI_SUM,
+                                comm, &requests[b]);
+        } else {
+            MPI_Iallreduce(contents, blockResults + (size_t)b * payload, payload, MPI_INT, MPI_SUM, comm, &requests[b]);
+        }
+        /* give the reductions already posted a chance to progress */
+        MPI_Testall(b + 1, requests, &done, MPI_STATUSES_IGNORE);
+        endPhase(PHASE_REDUCE);
+    }
+    beginPhase(PHASE_REDUCE);
+    MPI_Waitall(blocks, requests, MPI_STATUSES_IGNORE);
+
+    memcpy(distributedContents, blockResults, sizeof(int) * resultLength);
+    for (b = 1; b < blocks; b++) {
+        const int* result = blockResults + (size_t)b * resultLength;
+        for (i = 0; i < resultLength; i++) {
+            distributedContents[i] += result[i];
+        }
+    }
+    endPhase(PHASE_REDUCE);
+    return busy;
+}
+
+/*
+ * turn the reduced base counts into the new consensus centroids, using
+ * distributedCentroids as scratch. Stores how many bases of each centroid
+ * changed in drift and returns their sum.
+ */
+static int updateConsensus(const int* distributedContents, int cluster, int dimension, int words,
+                           uint64_t* centroids, uint64_t* distributedCentroids, int* drift) {
+    int sumDistance = 0;
+    int i;
+
+    for (i = 0; i < cluster; i++) {
+        uint64_t* centroid = distributedCentroids + i * words;
+        /* an empty cluster keeps its centroid */
+        if (packedConsensus(distributedContents + i * dimension * 4, centroid, dimension) == 0) {
+            memcpy(centroid, centroids + i * words, sizeof(uint64_t) * words);
+        }
+        /* update the difference of centroids */
+        drift[i] = packedDNADistance(centroid, centroids + words * i, words);
+        sumDistance += drift[i];
+    }
+    memcpy(centroids, distributedCentroids, sizeof(uint64_t) * cluster * words);
+    return sumDistance;
+}
+
+/*
+ * give every process the consensus strands of the clusters the others own:
+ * each owner sends the packed words of its clusters followed by their
+ * drift, packets lays out where every process's clusters go. Fills in
+ * centroids and drift and returns the sum of the drift.
+ */
+static int shareOwnedCentroids(MPI_Comm comm, int cluster, int words, int firstCluster, int ownedClusters,
+                               const int* packetCounts, const int* packetDispls, uint64_t* packets,
+                               uint64_t* gathered, uint64_t* centroids, int* drift) {
+    int sumDistance = 0;
+    int i;
+
+    for (i = 0; i < ownedClusters; i++) {
+        uint64_t* packet = packets + (size_t)i * (words + 1);
+        memcpy(packet, centroids + (size_t)(firstCluster + i) * words, sizeof(uint64_t) * words);
+        packet[words] = (uint64_t)drift[firstCluster + i];
+    }
+    MPI_Allgatherv(packets, ownedClusters * (words + 1), MPI_UINT64_T, gathered, (int*)packetCounts,
+                   (int*)packetDispls, MPI_UINT64_T, comm);
+    for (i = 0; i < cluster; i++) {
+        const uint64_t* packet = gathered + (size_t)i * (words + 1);
+        memcpy(centroids + (size_t)i * words, packet, sizeof(uint64_t) * words);
+        drift[i] = (int)packet[words];
+        sumDistance += drift[i];
+    }
+    return sumDistance;
+}
+
+/*
+ * k-means over packed DNA strands (see dnapack.h) spread over the
+ * processes of comm. Every process holds localRows strands and the same
+ * packed centroids, which are the seeds on entry and the result on return.
+ * The category of every local strand is stored in categories. Returns the
+ * number of iterations.
+ */
+int dnaKMeans(MPI_Comm comm, uint64_t** rows, int* localRows, int dimension, int cluster,
+              const KMeansOptions* options, uint64_t* centroids, int** categories) {
+    int i, t;
+    int iterations = 0;
+    int words = packedWords(dimension);
+    /* how long the threads of this process took to assign and count its strands, and whether strands just moved */
+    double busy = 0;
+    int rebalanced = 0;
+
+    if (options->miniBatch > 0) {
+        return dnaMiniBatch(comm, *rows, *localRows, dimension, cluster, options, centroids, *categories);
+    }
+
+    /* Example: Cluster = 2, Dimension = 4 */
+    /* A             C              G               T          */
+    /*  0| 4| 8|12   1 | 5| 9|13    2| 6|10|14      3| 7|11|15 */
+    /* 16|20|24|28   17|21|25|29   18|22|26|30     19|23|27|31 */
+    /* the delta mode adds the number of strands that changed cluster */
+    int delta = options->delta;
+    int payload = cluster * dimension * 4 + (delta ? 1 : 0);
+
+    /* with --owned-centroids every process reduces and updates a slice of the
+     * clusters and gathers the other consensus strands from their owners */
+    int owned = options->ownedCentroids;
+    int firstCluster = 0;
+    int ownedClusters = cluster;
+    int resultLength = payload;
+    int* sliceCounts = NULL;
+    int* packetCounts = NULL;
+    int* packetDispls = NULL;
+    uint64_t* packets = NULL;
+    uint64_t* gathered = NULL;
+    if (owned) {
+        int rank, numprocs, p;
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &numprocs);
+        sliceCounts = malloc(sizeof(int) * numprocs);
+        packetCounts = malloc(sizeof(int) * numprocs);
+        packetDispls = malloc(sizeof(int) * numprocs);
+        for (p = 0; p < numprocs; p++) {
+            int first, clusters;
+            partitionRows(cluster, numprocs, p, &first, &clusters);
+            sliceCounts[p] = clusters * dimension * 4;
+            packetCounts[p] = clusters * (words + 1);
+            packetDispls[p] = first * (words + 1);
+        }
+        partitionRows(cluster, numprocs, rank, &firstCluster, &ownedClusters);
+        resultLength = ownedClusters * dimension * 4;
+        packets = malloc(sizeof(uint64_t) * (ownedClusters > 0 ? ownedClusters : 1) * (words + 1));
+        gathered = malloc(sizeof(uint64_t) * cluster * (words + 1));
+    }
+
+    /* the threads of this process and their own counts, merged into the first block */
+    ThreadPool* pool = createThreadPool(options->threads);
+    int threads = poolThreads(pool);
+    int stride;
+    int* newGeneratedContents = allocateThreadBlocks(threads, payload, sizeof(int), &stride);
+    int* distributedContents = malloc(sizeof(int) * (resultLength > 0 ? resultLength : 1));
+
+    /* the packed centroids for every cluster computed */
+    uint64_t* distributedCentroids = malloc(sizeof(uint64_t) * cluster * words);
+    /* how many bases of each centroid changed in the last update */
+    int* drift = malloc(sizeof(int) * cluster);
+
+    /* the delta mode keeps the counts of all strands, the same on every process, and
+     * the category every local strand was counted under, none at the start. The
+     * counts are exact, so unlike the vector engine they never need a fresh start.
+     * An owner only keeps the counts of its own clusters. */
+    int* totals = NULL;
+    int* previous = NULL;
+    int changed = 0;
+    if (delta) {
+        totals = calloc(resultLength > 0 ? resultLength : 1, sizeof(int));
+        previous = malloc(sizeof(int) * (*localRows > 0 ? *localRows : 1));
+        for (i = 0; i < *localRows; i++) {
+            previous[i] = -1;
+        }
+    }
+
+    /* the bounds of the pruned assignment, see bounds.h */
+    int prune = options->prune;
+    int* upper = NULL;
+    int* lower = NULL;
+    int* separation = NULL;
+    int* centroidDistances = NULL;
+    if (prune != PRUNE_NONE) {
+        upper = malloc(sizeof(int) * *localRows);
+        lower = malloc(sizeof(int) * *localRows * lowerBoundsPerRow(prune, cluster));
+        separation = malloc(sizeof(int) * cluster);
+        if (prune == PRUNE_ELKAN) {
+            centroidDistances = malloc(sizeof(int) * cluster * cluster);
+        }
+    }
+
+    /* the pipelined mode keeps the counts and the reduced counts of every block */
+    int blocks = options->pipeline > 1 ? options->pipeline : 1;
+    int* blockContents = NULL;
+    int* blockResults = NULL;
+    MPI_Request* requests = NULL;
+    if (blocks > 1) {
+        blockContents = malloc(sizeof(int) * payload * blocks);
+        blockResults = malloc(sizeof(int) * (resultLength > 0 ? resultLength : 1) * blocks);
+        requests = malloc(sizeof(MPI_Request) * blocks);
+    }
+
+    ThreadTimes* times = malloc(sizeof(ThreadTimes) * threads);
+    BaseCounter** counters = createThreadCounters(threads, cluster, dimension, delta);
+    DNAStep step = {*rows, *localRows, dimension, words, cluster, prune, 1, centroids, drift, centroidDistances,
+                    separation, *categories, upper, lower, newGeneratedContents, stride, times, previous, counters};
+
+    do {
+        /* the diffrenciation of centroids between orginal and new genereated */
+        int sumDistance;
+
+        iterations++;
+        nextIteration();
+        /* the bounds start over on the first iteration and for strands that just moved */
+        step.first = iterations == 1 || rebalanced;
+        rebalanced = 0;
+
+        if (blocks > 1) {
+            busy += pipelinedDNAPass(comm, pool, &step, blocks,
+                                     prune != PRUNE_NONE ? lowerBoundsPerRow(prune, cluster) : 0,
+                                     payload, sliceCounts, resultLength, blockContents, blockResults, requests,
+                                     distributedContents);
+        } else {
+            /* assign and count every strand, each thread its own share */
+            runThreadPool(pool, dnaStep, &step);
+            busy += recordThreadTimes(times, threads);
+            beginPhase(PHASE_ACCUMULATE);
+            for (t = 1; t < threads; t++) {
+                const int* block = newGeneratedContents + (size_t)t * stride;
+                for (i = 0; i < payload; i++) {
+                    newGeneratedContents[i] += block[i];
+                }
+            }
+            endPhase(PHASE_ACCUMULATE);
+
+            /* reduce step - the character counts in every position of each point reach every
+             * process, or only those of its own clusters reach each owner */
+            beginPhase(PHASE_REDUCE);
+            if (owned) {
+                MPI_Reduce_scatter(newGeneratedContents, distributedContents, sliceCounts, MPI_INT, MPI_SUM, comm);
+            } else {
+                MPI_Allreduce(newGeneratedContents, distributedContents, payload, MPI_INT, MPI_SUM, comm);
+            }
+            endPhase(PHASE_REDUCE);
+        }
+
+        /* every process sees the same counts, so each one computes the new
+         * centroid for each cluster and the termination itself */
+        beginPhase(PHASE_UPDATE);
+        if (delta) {
+            /* the reduced counts are the changes to the totals */
+            for (i = 0; i < (owned ? resultLength : payload - 1); i++) {
+                totals[i] += distributedContents[i];
+            }
+            if (owned) {
+                /* the slices leave out the count of changed strands, it is reduced on its own */
+                int localChanged = 0;
+                int b;
+                for (b = 0; b < blocks; b++) {
+                    localChanged += (blocks > 1 ? blockContents + (size_t)b * payload : newGeneratedContents)[payload - 1];
+                }
+                MPI_Allreduce(&localChanged, &changed, 1, MPI_INT, MPI_SUM, comm);
+            } else {
+                changed = distributedContents[payload - 1];
+            }
+        }
+        sumDistance = updateConsensus(delta ? totals : distributedContents, ownedClusters, dimension, words,
+                                      centroids + (size_t)firstCluster * words, distributedCentroids,
+                                      drift + firstCluster);
+        if (owned) {
+            sumDistance = shareOwnedCentroids(comm, cluster, words, firstCluster, ownedClusters, packetCounts,
+                                              packetDispls, packets, gathered, centroids, drift);
+        }
+        endPhase(PHASE_UPDATE);
+
+        /* see if it is time to terminate */
+        if (sumDistance <= DNA_DIFF_THRESHOLD) {
+            break;
+        }
+        /* or if hardly any strand changed cluster */
+        if (delta && iterations > 1 && changed <= options->minChanged) {
+            break;
+        }
+        if (options->maxIterations > 0 && iterations >= options->maxIterations) {
+            break;
+        }
+
+        /* the first iterations have shown how fast every process is, the faster ones take over strands */
+        if (iterations == options->rebalance &&
+            rebalanceRows(comm, (void**)rows, localRows, sizeof(uint64_t) * words, busy)) {
+            *categories = realloc(*categories, sizeof(int) * (*localRows > 0 ? *localRows : 1));
+            step.rows = *rows;
+            step.localRows = *localRows;
+            step.categories = *categories;
+            if (prune != PRUNE_NONE) {
+                upper = realloc(upper, sizeof(int) * (*localRows > 0 ? *localRows : 1));
+                lower = realloc(lower, sizeof(int) * (*localRows > 0 ? *localRows : 1) * lowerBoundsPerRow(prune, cluster));
+                step.upper = upper;
+                step.lower = lower;
+            }
+            if (delta) {
+                /* the strands that moved are counted again from zero */
+                previous = realloc(previous, sizeof(int) * (*localRows > 0 ? *localRows : 1));
+                step.previous = previous;
+                memset(totals, 0, sizeof(int) * (resultLength > 0 ? resultLength : 1));
+                for (i = 0; i < *localRows; i++) {
+                    previous[i] = -1;
+                }
+            }
+            rebalanced = 1;
+        }
+
+        /* the threads loosen the bounds by the drift at the start of the next iteration */
+        if (prune != PRUNE_NONE) {
+            beginPhase(PHASE_UPDATE);
+            dnaCentroidSeparation(centroids, cluster, words, centroidDistances, separation);
+            endPhase(PHASE_UPDATE);
+        }
+    } while (1);
+    endIterations();
+
+    destroyThreadPool(pool);
+    free(times);
+    freeThreadCounters(counters, threads);
+    free(newGeneratedContents);
+    free(distributedContents);
+    free(distributedCentroids);
+    free(drift);
+    free(totals);
+    free(previous);
+    free(upper);
+    free(lower);
+    free(separation);
+    free(centroidDistances);
+    free(blockContents);
+    free(blockResults);
+    free(requests);
+    free(sliceCounts);
+    free(packetCounts);
+    free(packetDispls);
+    free(packets);
+    free(gathered);
+    return iterations;
+}
+
+/*
+ * k-means over the packed strands of a RowStream, read again in chunks on
+ * every iteration. Every process holds the same packed centroids, which
+ * are the seeds on entry and the result on return. The categories of the
+ * last assignment are written to labels, one int per local strand, unless
+ * it is MPI_FILE_NULL. Returns the number of iterations.
+ */
+int dnaKMeansStream(MPI_Comm comm, RowStream* stream, int dimension, int cluster,
+                    const KMeansOptions* options, uint64_t* centroids, MPI_File labels) {
+    int i, t;
+    int iterations = 0;
+    int words = packedWords(dimension);
+    int first, count;
+    const void* chunk;
+
+    int payload = cluster * dimension * 4;
+    ThreadPool* pool = createThreadPool(options->threads);
+    int threads = poolThreads(pool);
+    int stride;
+    int* threadContents = allocateThreadBlocks(threads, payload, sizeof(int), &stride);
+    /* the counts of every chunk of this process */
+    int* newGeneratedContents = malloc(sizeof(int) * payload);
+    int* distributedContents = malloc(sizeof(int) * payload);
+    uint64_t* distributedCentroids = malloc(sizeof(uint64_t) * cluster * words);
+    int* drift = malloc(sizeof(int) * cluster);
+    /* the categories of one chunk, on their way to labels */
+    int* categories = malloc(sizeof(int) * options->stream);
+
+    /* the bounds would need every strand in memory, so every strand is compared with every centroid */
+    ThreadTimes* times = malloc(sizeof(ThreadTimes) * threads);
+    BaseCounter** counters = createThreadCounters(threads, cluster, dimension, 0);
+    DNAStep step = {NULL, 0, dimension, words, cluster, PRUNE_NONE, 1, centroids, NULL, NULL, NULL,
+                    categories, NULL, NULL, threadContents, stride, times, NULL, counters};
+
+    do {
+        int sumDistance;
+
+        iterations++;
+        nextIteration();
+        memset(newGeneratedContents, 0, sizeof(int) * payload);
+
+        /* the next chunk is read while the threads work on this one */
+        beginPhase(PHASE_READ);
+        rewindRowStream(stream);
+        while ((chunk = nextRowChunk(stream, &first, &count)) != NULL) {
+            endPhase(PHASE_READ);
+            step.rows = chunk;
+            step.localRows = count;
+            runThreadPool(pool, dnaStep, &step);
+            recordThreadTimes(times, threads);
+            beginPhase(PHASE_ACCUMULATE);
+            for (t = 0; t < threads; t++) {
+                const int* block = threadContents + (size_t)t * stride;
+                for (i = 0; i < payload; i++) {
+                    newGeneratedContents[i] += block[i];
+                }
+            }
+            endPhase(PHASE_ACCUMULATE);
+            if (labels != MPI_FILE_NULL) {
+                beginPhase(PHASE_GATHER);
+                MPI_File_write_at(labels, (MPI_Offset)first * sizeof(int), categories, count, MPI_INT, MPI_STATUS_IGNORE);
+                endPhase(PHASE_GATHER);
+            }
+            beginPhase(PHASE_READ);
+        }
+        endPhase(PHASE_READ);
+
+        beginPhase(PHASE_REDUCE);
+        MPI_Allreduce(newGeneratedContents, distributedContents, payload, MPI_INT, MPI_SUM, comm);
+        endPhase(PHASE_REDUCE);
+        beginPhase(PHASE_UPDATE);
+        sumDistance = updateConsensus(distributedContents, cluster, dimension, words, centroids,
+                                      distributedCentroids, drift);
+        endPhase(PHASE_UPDATE);
+
+        if (sumDistance <= DNA_DIFF_THRESHOLD) {
+            break;
+        }
+    } while (options->maxIterations == 0 || iterations < options->maxIterations);
+    endIterations();
+
+    destroyThreadPool(pool);
+    free(times);
+    freeThreadCounters(counters, threads);
+    free(threadContents);
+    free(newGeneratedContents);
+    free(distributedContents);
+    free(distributedCentroids);
+    free(drift);
+    free(categories);
+    return iterations;
+}
+
+/*
+ * the sum of the Hamming distances of the local strands to the centroids of their categories
+ */
+double dnaCost(const uint64_t* rows, int localRows, int dimension, const uint64_t* centroids, const int* categories) {
+    int words = packedWords(dimension);
+    double cost = 0;
+    int i;
+
+    for (i = 0; i < localRows; i++) {
+        cost += packedDNADistance(centroids + (size_t)categories[i] * words, rows + (size_t)i * words, words);
+    }
+    return cost;
+}
+
+/*
+ * the sum of the simplified silhouettes of the local strands: (b - a) / max(a, b)
+ * with a the Hamming distance to the centroid of the strand and b to the nearest other one
+ */
+double dnaSilhouette(const uint64_t* rows, int localRows, int dimension, const uint64_t* centroids, int cluster,
+                     const int* categories) {
+    int words = packedWords(dimension);
+    double sum = 0;
+    int i, c;
+
+    for (i = 0; i < localRows && cluster > 1; i++) {
+        const uint64_t* strand = rows + (size_t)i * words;
+        int own = packedDNADistance(centroids + (size_t)categories[i] * words, strand, words);
+        int other = dimension + 1;
+        for (c = 0; c < cluster; c++) {
+            int d = packedDNADistance(centroids + (size_t)c * words, strand, words);
+            other = c != categories[i] && d < other ? d : other;
+        }
+        if (own != other) {
+            sum += (double)(other - own) / (own > other ? own : other);
+        }
+    }
+    return sum;
+}
@@ -0,0 +1,47 @@
+#ifndef _DNAKMEANS_H_
+#define _DNAKMEANS_H_
+
+#include <stdint.h>
+#include "mpi.h"
+#include "util.h"
+#include "rowstream.h"
+
+/* This is the threshold to end the calculation for DNA */
+#define DNA_DIFF_THRESHOLD 1
+
+/*
+ * k-means over packed DNA strands (see dnapack.h) spread over the
+ * processes of comm. Every process holds localRows strands and the same
+ * packed centroids, which are the seeds on entry and the result on return.
+ * The category of every local strand is stored in categories. Returns the
+ * number of iterations. With options->miniBatch set, each iteration only
+ * uses a random batch of strands, see dnaMiniBatch. With options->rebalance
+ * set, strands move between the processes (see rebalance.h): rows,
+ * localRows and categories are then replaced, categories reallocated to
+ * match.
+ */
+int dnaKMeans(MPI_Comm comm, uint64_t** rows, int* localRows, int dimension, int cluster,
+              const KMeansOptions* options, uint64_t* centroids, int** categories);
+
+/*
+ * k-means over the packed strands of a RowStream, read again in chunks of
+ * options->stream strands on every iteration. The categories of the last
+ * assignment are written to labels, one int per local strand, unless it is
+ * MPI_FILE_NULL. Returns the number of iterations.
+ */
+int dnaKMeansStream(MPI_Comm comm, RowStream* stream, int dimension, int cluster,
+                    const KMeansOptions* options, uint64_t* centroids, MPI_File labels);
+
+/*
+ * the sum of the Hamming distances of the local strands to the centroids of their categories
+ */
+double dnaCost(const uint64_t* rows, int localRows, int dimension, const uint64_t* centroids, const int* categories);
+
+/*
+ * the sum of the simplified silhouettes of the local strands: (b - a) / max(a, b)
+ * with a the Hamming distance to the centroid of the strand and b to the nearest other one
+ */
+double dnaSilhouette(const uint64_t* rows, int localRows, int dimension, const uint64_t* centroids, int cluster,
+                     const int* categories);
+
+#endif
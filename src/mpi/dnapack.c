@@ -0,0 +1,381 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dnapack.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DNAPACK_X86 1
+#include <immintrin.h>
+#endif
+
+/* the low bit of every 2-bit base */
+#define LOW_BITS 0x5555555555555555ULL
+
+/* the signature shared by every distance kernel */
+typedef int (*PackedDistanceKernel)(const uint64_t* centroid, const uint64_t* strand, int words);
+
+/*
+ * the number of packed words needed by one strand
+ */
+int packedWords(int dimension) {
+    return (dimension + BASES_PER_WORD - 1) / BASES_PER_WORD;
+}
+
+/*
+ * the 2-bit code of a base, unknown characters are treated as 'A'
+ */
+int baseCode(char base) {
+    switch (base) {
+        case 'C':
+        case 'c':
+            return 1;
+        case 'G':
+        case 'g':
+            return 2;
+        case 'T':
+        case 't':
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * pack a strand of characters
+ */
+void packDNA(const char* strand, uint64_t* packed, int dimension) {
+    int i;
+    memset(packed, 0, sizeof(uint64_t) * packedWords(dimension));
+    for (i = 0; i < dimension; i++) {
+        packed[i / BASES_PER_WORD] |= (uint64_t)baseCode(strand[i]) << (2 * (i % BASES_PER_WORD));
+    }
+}
+
+/*
+ * unpack a packed strand back into characters
+ */
+void unpackDNA(const uint64_t* packed, char* strand, int dimension) {
+    int i;
+    for (i = 0; i < dimension; i++) {
+        strand[i] = "ACGT"[packedBase(packed, i)];
+    }
+}
+
+/*
+ * XOR leaves a non-zero pair wherever the bases differ, folding the high bit
+ * of each pair onto the low one leaves exactly one bit per mismatch
+ */
+static int distanceScalar(const uint64_t* centroid, const uint64_t* strand, int words) {
+    int i;
+    int sum = 0;
+    for (i = 0; i < words; i++) {
+        uint64_t diff = centroid[i] ^ strand[i];
+        sum += __builtin_popcountll((diff | (diff >> 1)) & LOW_BITS);
+    }
+    return sum;
+}
+
+#ifdef DNAPACK_X86
+
+/*
+ * the same loop with the hardware popcnt instruction
+ */
+__attribute__((target("popcnt")))
+static int distancePopcnt(const uint64_t* centroid, const uint64_t* strand, int words) {
+    int i;
+    int sum = 0;
+    for (i = 0; i < words; i++) {
+        uint64_t diff = centroid[i] ^ strand[i];
+        sum += __builtin_popcountll((diff | (diff >> 1)) & LOW_BITS);
+    }
+    return sum;
+}
+
+/*
+ * AVX2 : 4 words per step, bytes are counted with a nibble lookup table
+ * and summed into 64-bit lanes with sad
+ */
+__attribute__((target("avx2,popcnt")))
+static int distanceAVX2(const uint64_t* centroid, const uint64_t* strand, int words) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i lowBits = _mm256_set1_epi64x((long long)LOW_BITS);
+    __m256i total = _mm256_setzero_si256();
+    int i = 0;
+    int sum;
+
+    for (; i + 4 <= words; i += 4) {
+        __m256i diff = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(centroid + i)),
+                                        _mm256_loadu_si256((const __m256i*)(strand + i)));
+        __m256i mismatch = _mm256_and_si256(_mm256_or_si256(diff, _mm256_srli_epi64(diff, 1)), lowBits);
+        __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(mismatch, nibble)),
+                                         _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(mismatch, 4), nibble)));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+    }
+    sum = (int)(_mm256_extract_epi64(total, 0) + _mm256_extract_epi64(total, 1)
+                + _mm256_extract_epi64(total, 2) + _mm256_extract_epi64(total, 3));
+
+    /* the remaining words */
+    for (; i < words; i++) {
+        uint64_t diff = centroid[i] ^ strand[i];
+        sum += __builtin_popcountll((diff | (diff >> 1)) & LOW_BITS);
+    }
+    return sum;
+}
+
+/*
+ * AVX-512BW : 8 words per step with the lookup table, the tail is loaded with a mask
+ */
+__attribute__((target("avx512f,avx512bw")))
+static int distanceAVX512BW(const uint64_t* centroid, const uint64_t* strand, int words) {
+    const __m512i table = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+    const __m512i nibble = _mm512_set1_epi8(0x0f);
+    const __m512i lowBits = _mm512_set1_epi64((long long)LOW_BITS);
+    __m512i total = _mm512_setzero_si512();
+    int i;
+
+    for (i = 0; i < words; i += 8) {
+        __mmask8 mask = words - i >= 8 ? 0xff : (__mmask8)((1u << (words - i)) - 1);
+        __m512i diff = _mm512_xor_si512(_mm512_maskz_loadu_epi64(mask, centroid + i),
+                                        _mm512_maskz_loadu_epi64(mask, strand + i));
+        __m512i mismatch = _mm512_and_si512(_mm512_or_si512(diff, _mm512_srli_epi64(diff, 1)), lowBits);
+        __m512i counts = _mm512_add_epi8(_mm512_shuffle_epi8(table, _mm512_and_si512(mismatch, nibble)),
+                                         _mm512_shuffle_epi8(table, _mm512_and_si512(_mm512_srli_epi16(mismatch, 4), nibble)));
+        total = _mm512_add_epi64(total, _mm512_sad_epu8(counts, _mm512_setzero_si512()));
+    }
+    return (int)_mm512_reduce_add_epi64(total);
+}
+
+/*
+ * AVX-512 VPOPCNTDQ : 8 words per step with the vector popcount instruction
+ */
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static int distanceAVX512Popcnt(const uint64_t* centroid, const uint64_t* strand, int words) {
+    const __m512i lowBits = _mm512_set1_epi64((long long)LOW_BITS);
+    __m512i total = _mm512_setzero_si512();
+    int i;
+
+    for (i = 0; i < words; i += 8) {
+        __mmask8 mask = words - i >= 8 ? 0xff : (__mmask8)((1u << (words - i)) - 1);
+        __m512i diff = _mm512_xor_si512(_mm512_maskz_loadu_epi64(mask, centroid + i),
+                                        _mm512_maskz_loadu_epi64(mask, strand + i));
+        __m512i mismatch = _mm512_and_si512(_mm512_or_si512(diff, _mm512_srli_epi64(diff, 1)), lowBits);
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(mismatch));
+    }
+    return (int)_mm512_reduce_add_epi64(total);
+}
+
+#endif
+
+/* the kernel chosen for this CPU, selected on first use */
+static PackedDistanceKernel distanceKernel = NULL;
+
+/*
+ * choose the widest kernel the CPU supports
+ */
+static PackedDistanceKernel selectDistanceKernel(void) {
+#ifdef DNAPACK_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq")) {
+        return distanceAVX512Popcnt;
+    }
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        return distanceAVX512BW;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        return distanceAVX2;
+    }
+    if (__builtin_cpu_supports("popcnt")) {
+        return distancePopcnt;
+    }
+#endif
+    return distanceScalar;
+}
+
+/*
+ * DNA : the Hamming distance between two packed strands
+ */
+int packedDNADistance(const uint64_t* centroid, const uint64_t* strand, int words) {
+    if (distanceKernel == NULL) {
+        distanceKernel = selectDistanceKernel();
+    }
+    return distanceKernel(centroid, strand, words);
+}
+
+/*
+ * DNA : the index of the nearest packed centroid, its distance is stored in distance
+ */
+int nearestPackedCentroid(const uint64_t* strand, const uint64_t* centroids, int cluster, int words, int* distance) {
+    int j;
+    int category = -1;
+    /* no distance can exceed the number of bases the words hold */
+    int minDistance = words * BASES_PER_WORD + 1;
+
+    if (distanceKernel == NULL) {
+        distanceKernel = selectDistanceKernel();
+    }
+    for (j = 0; j < cluster; j++) {
+        int calculatedDistance = distanceKernel(centroids + (size_t)j * words, strand, words);
+        if (calculatedDistance < minDistance) {
+            minDistance = calculatedDistance;
+            category = j;
+        }
+    }
+    if (distance != NULL) {
+        *distance = minDistance;
+    }
+    return category;
+}
+
+/*
+ * DNA : the consensus of one cluster from its base counts, laid out as
+ * counts[4 * position + code]. The most frequent base wins, ties go to
+ * the first of A, C, G, T. Returns the number of strands counted and
+ * leaves the centroid untouched when there are none.
+ */
+int packedConsensus(const int* counts, uint64_t* centroid, int dimension) {
+    int j;
+    int members = counts[0] + counts[1] + counts[2] + counts[3];
+
+    if (members == 0) {
+        return 0;
+    }
+    memset(centroid, 0, sizeof(uint64_t) * packedWords(dimension));
+    for (j = 0; j < dimension; j++) {
+        const int* count = counts + 4 * j;
+        /* two rounds of compare and select without branches, the strict
+         * comparisons let the earlier base win a tie */
+        int bestLow = count[1] > count[0];
+        int maxLow = count[bestLow];
+        int bestHigh = 2 + (count[3] > count[2]);
+        int maxHigh = count[bestHigh];
+        int best = maxHigh > maxLow ? bestHigh : bestLow;
+        centroid[j / BASES_PER_WORD] |= (uint64_t)best << (2 * (j % BASES_PER_WORD));
+    }
+    return members;
+}
+
+struct BaseCounter {
+    int cluster;
+    int dimension;
+    int words;
+    /* planes[((category * words + word) * BASECOUNT_PLANES + plane) * 3 + code - 1] */
+    uint64_t* planes;
+    /* the strands of each cluster held by the planes */
+    int* pending;
+    int* counts;
+    int sign;
+};
+
+BaseCounter* createBaseCounter(int cluster, int dimension) {
+    BaseCounter* counter = malloc(sizeof(BaseCounter));
+    counter->cluster = cluster;
+    counter->dimension = dimension;
+    counter->words = packedWords(dimension);
+    counter->planes = calloc((size_t)cluster * counter->words * 3 * BASECOUNT_PLANES, sizeof(uint64_t));
+    counter->pending = calloc(cluster, sizeof(int));
+    counter->counts = NULL;
+    counter->sign = 1;
+    return counter;
+}
+
+/*
+ * start counting from zero into counts, laid out as for packedConsensus
+ * for every cluster in turn; sign is 1 to add the strands or -1 to remove them
+ */
+void resetBaseCounter(BaseCounter* counter, int* counts, int sign) {
+    memset(counter->planes, 0, sizeof(uint64_t) * counter->cluster * counter->words * 3 * BASECOUNT_PLANES);
+    memset(counter->pending, 0, sizeof(int) * counter->cluster);
+    counter->counts = counts;
+    counter->sign = sign;
+}
+
+/*
+ * add the planes of one cluster to its counts and clear them
+ */
+static void widenCluster(BaseCounter* counter, int category) {
+    uint64_t* planes = counter->planes + (size_t)category * counter->words * 3 * BASECOUNT_PLANES;
+    int* counts = counter->counts + (size_t)category * counter->dimension * 4;
+    int pending = counter->pending[category] * counter->sign;
+    int word, code, plane, j;
+
+    /* every strand counts as an A until one of the other bases takes it */
+    for (j = 0; j < counter->dimension; j++) {
+        counts[4 * j] += pending;
+    }
+    for (word = 0; word < counter->words; word++) {
+        for (plane = 0; plane < BASECOUNT_PLANES; plane++) {
+            uint64_t* level = planes + (word * BASECOUNT_PLANES + plane) * 3;
+            int weight = counter->sign << plane;
+            for (code = 1; code < 4; code++) {
+                uint64_t bits = level[code - 1];
+                while (bits != 0) {
+                    /* the low bit of the pair of position j */
+                    j = word * BASES_PER_WORD + __builtin_ctzll(bits) / 2;
+                    counts[4 * j + code] += weight;
+                    counts[4 * j] -= weight;
+                    bits &= bits - 1;
+                }
+                level[code - 1] = 0;
+            }
+        }
+    }
+    counter->pending[category] = 0;
+}
+
+/*
+ * count the bases of a packed strand for cluster category
+ */
+void countStrand(BaseCounter* counter, int category, const uint64_t* strand) {
+    uint64_t* planes = counter->planes + (size_t)category * counter->words * 3 * BASECOUNT_PLANES;
+    int word;
+
+    for (word = 0; word < counter->words; word++) {
+        uint64_t low = strand[word] & LOW_BITS;
+        uint64_t high = (strand[word] >> 1) & LOW_BITS;
+        /* one bit at the low bit of every position holding C, G or T */
+        uint64_t carryC = low & ~high;
+        uint64_t carryG = high & ~low;
+        uint64_t carryT = high & low;
+        uint64_t* level = planes + (size_t)word * BASECOUNT_PLANES * 3;
+        int p;
+        /* add one to every position of each mask, a ripple carry through all
+         * planes: a fixed number of steps is cheaper than a branch on the
+         * carry, and the three bases keep three independent chains going */
+#pragma GCC unroll 8
+        for (p = 0; p < BASECOUNT_PLANES; p++, level += 3) {
+            uint64_t nextC = level[0] & carryC;
+            uint64_t nextG = level[1] & carryG;
+            uint64_t nextT = level[2] & carryT;
+            level[0] ^= carryC;
+            level[1] ^= carryG;
+            level[2] ^= carryT;
+            carryC = nextC;
+            carryG = nextG;
+            carryT = nextT;
+        }
+    }
+    /* the next strand could carry out of the top plane */
+    if (++counter->pending[category] == (1 << BASECOUNT_PLANES) - 1) {
+        widenCluster(counter, category);
+    }
+}
+
+/*
+ * widen whatever the planes still hold into the counts
+ */
+void flushBaseCounter(BaseCounter* counter) {
+    int i;
+    for (i = 0; i < counter->cluster; i++) {
+        if (counter->pending[i] > 0) {
+            widenCluster(counter, i);
+        }
+    }
+}
+
+void freeBaseCounter(BaseCounter* counter) {
+    free(counter->planes);
+    free(counter->pending);
+    free(counter);
+}
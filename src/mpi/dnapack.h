@@ -0,0 +1,95 @@
+#ifndef _DNAPACK_H_
+#define _DNAPACK_H_
+
+#include <stdint.h>
+
+/*
+ * DNA strands are packed at 2 bits per base (A=0, C=1, G=2, T=3) into
+ * 64-bit words, base i of a strand living in bits 2*(i%32) of word i/32.
+ * The unused bits of the last word are always zero.
+ */
+
+/* the number of bases held by one packed word */
+#define BASES_PER_WORD 32
+
+/*
+ * the number of packed words needed by one strand
+ */
+int packedWords(int dimension);
+
+/*
+ * the 2-bit code of a base, unknown characters are treated as 'A'
+ */
+int baseCode(char base);
+
+/*
+ * the 2-bit code of the base at the given position of a packed strand
+ */
+static inline int packedBase(const uint64_t* packed, int index) {
+    return (int)((packed[index / BASES_PER_WORD] >> (2 * (index % BASES_PER_WORD))) & 3);
+}
+
+/*
+ * pack a strand of characters
+ */
+void packDNA(const char* strand, uint64_t* packed, int dimension);
+
+/*
+ * unpack a packed strand back into characters
+ */
+void unpackDNA(const uint64_t* packed, char* strand, int dimension);
+
+/*
+ * DNA : the Hamming distance between two packed strands
+ */
+int packedDNADistance(const uint64_t* centroid, const uint64_t* strand, int words);
+
+/*
+ * DNA : the index of the nearest packed centroid, its distance is stored in distance
+ */
+int nearestPackedCentroid(const uint64_t* strand, const uint64_t* centroids, int cluster, int words, int* distance);
+
+/*
+ * DNA : the consensus of one cluster from its base counts, laid out as
+ * counts[4 * position + code]. The most frequent base wins, ties go to
+ * the first of A, C, G, T. Returns the number of strands counted and
+ * leaves the centroid untouched when there are none.
+ */
+int packedConsensus(const int* counts, uint64_t* centroid, int dimension);
+
+/*
+ * Bit-sliced base counting for the consensus. For every cluster, word and
+ * base code a counter keeps BASECOUNT_PLANES bit planes, plane p holding
+ * bit p of the counts of all 32 positions of the word at once, so adding a
+ * strand takes a few word operations per 32 bases instead of one increment
+ * per base. The planes of a cluster are widened into the int counts before
+ * they can overflow. Only C, G and T are counted, A is the number of
+ * strands minus the other three.
+ */
+
+/* the bit planes of one counter, so a cluster is widened every 2^8 - 1 strands */
+#define BASECOUNT_PLANES 8
+
+typedef struct BaseCounter BaseCounter;
+
+BaseCounter* createBaseCounter(int cluster, int dimension);
+
+/*
+ * start counting from zero into counts, laid out as for packedConsensus
+ * for every cluster in turn; sign is 1 to add the strands or -1 to remove them
+ */
+void resetBaseCounter(BaseCounter* counter, int* counts, int sign);
+
+/*
+ * count the bases of a packed strand for cluster category
+ */
+void countStrand(BaseCounter* counter, int category, const uint64_t* strand);
+
+/*
+ * widen whatever the planes still hold into the counts
+ */
+void flushBaseCounter(BaseCounter* counter);
+
+void freeBaseCounter(BaseCounter* counter);
+
+#endif
@@ -0,0 +1,457 @@
+#include <stdlib.h>
+#include <string.h>
+#include "editkmeans.h"
+#include "threadpool.h"
+#include "timing.h"
+
+/* the limit of a distance without --band, far above any strand length */
+#define EDIT_NO_LIMIT (1 << 29)
+
+/*
+ * the work shared by the threads of one pass
+ */
+typedef struct {
+    const StrandArena* strands;
+    int* categories;
+    /* the strands compared against, for the medoid pass those of cluster c
+     * are patterns[candidateFirst[c]] up to candidateFirst[c + 1] */
+    const EditPattern* patterns;
+    int patternNums;
+    const int* candidateFirst;
+    int maxBlocks;
+    int limit;
+    /* for every thread stride apart: the strands that changed cluster and
+     * their summed distance, or the sums of the candidates */
+    double* sums;
+    int stride;
+} EditStep;
+
+/*
+ * assign the strands of one thread to the nearest medoid
+ */
+static void assignStrands(void* arg, int thread, int threads) {
+    EditStep* step = arg;
+    uint64_t* scratch = malloc(sizeof(uint64_t) * 3 * step->maxBlocks);
+    long long changed = 0;
+    double cost = 0;
+    int begin, end;
+    int i, c;
+
+    threadRows(step->strands->count, thread, threads, &begin, &end);
+    for (i = begin; i < end; i++) {
+        const uint64_t* strand = arenaStrand(step->strands, i);
+        int length = step->strands->lengths[i];
+        int best = -1;
+        int bestDistance = step->limit + 1;
+        for (c = 0; c < step->patternNums; c++) {
+            /* only a strictly nearer medoid matters, so the search narrows as it goes */
+            int distance = editDistance(&step->patterns[c], strand, length, bestDistance - 1, scratch);
+            if (distance < bestDistance) {
+                best = c;
+                bestDistance = distance;
+            }
+        }
+        if (best >= 0 && best != step->categories[i]) {
+            step->categories[i] = best;
+            changed++;
+        }
+        cost += bestDistance;
+    }
+    step->sums[(size_t)thread * step->stride] = changed;
+    step->sums[(size_t)thread * step->stride + 1] = cost;
+    free(scratch);
+}
+
+/*
+ * add the distances of the strands of one thread to every candidate of their cluster
+ */
+static void scoreCandidates(void* arg, int thread, int threads) {
+    EditStep* step = arg;
+    uint64_t* scratch = malloc(sizeof(uint64_t) * 3 * step->maxBlocks);
+    double* sums = step->sums + (size_t)thread * step->stride;
+    int begin, end;
+    int i, t;
+
+    threadRows(step->strands->count, thread, threads, &begin, &end);
+    for (i = begin; i < end; i++) {
+        const uint64_t* strand = arenaStrand(step->strands, i);
+        int length = step->strands->lengths[i];
+        int category = step->categories[i];
+        for (t = step->candidateFirst[category]; t < step->candidateFirst[category + 1]; t++) {
+            sums[t] += editDistance(&step->patterns[t], strand, length, step->limit, scratch);
+        }
+    }
+    free(scratch);
+}
+
+/*
+ * prepare every strand of an arena, returns the largest number of blocks
+ */
+static EditPattern* preparePatterns(const StrandArena* strands, int* maxBlocks) {
+    EditPattern* patterns = malloc(sizeof(EditPattern) * (strands->count > 0 ? strands->count : 1));
+    int i;
+
+    *maxBlocks = 1;
+    for (i = 0; i < strands->count; i++) {
+        prepareEditPattern(&patterns[i], arenaStrand(strands, i), strands->lengths[i]);
+        *maxBlocks = patterns[i].blocks > *maxBlocks ? patterns[i].blocks : *maxBlocks;
+    }
+    return patterns;
+}
+
+static void freePatterns(EditPattern* patterns, int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        freeEditPattern(&patterns[i]);
+    }
+    free(patterns);
+}
+
+/*
+ * gather the strands of every process of comm in rank order, each with an
+ * int tag, the tags of all of them are stored in allTags
+ */
+static StrandArena* allgatherStrands(MPI_Comm comm, const StrandArena* local, const int* tags, int** allTags) {
+    int numprocs;
+    int localWords = (int)local->wordCount;
+    int total = 0;
+    int totalWords = 0;
+    int* counts;
+    int* displs;
+    int* wordCounts;
+    int* wordDispls;
+    int* pairs;
+    int* allPairs;
+    uint64_t* words;
+    long long offset = 0;
+    StrandArena* all = createStrandArena();
+    int p, i;
+
+    MPI_Comm_size(comm, &numprocs);
+    counts = malloc(sizeof(int) * numprocs);
+    displs = malloc(sizeof(int) * numprocs);
+    wordCounts = malloc(sizeof(int) * numprocs);
+    wordDispls = malloc(sizeof(int) * numprocs);
+    MPI_Allgather((void*)&local->count, 1, MPI_INT, counts, 1, MPI_INT, comm);
+    MPI_Allgather(&localWords, 1, MPI_INT, wordCounts, 1, MPI_INT, comm);
+    for (p = 0; p < numprocs; p++) {
+        /* every strand travels as its tag and its length */
+        counts[p] *= 2;
+        displs[p] = 2 * total;
+        total += counts[p] / 2;
+        wordDispls[p] = totalWords;
+        totalWords += wordCounts[p];
+    }
+
+    pairs = malloc(sizeof(int) * 2 * (local->count > 0 ? local->count : 1));
+    for (i = 0; i < local->count; i++) {
+        pairs[2 * i] = tags[i];
+        pairs[2 * i + 1] = local->lengths[i];
+    }
+    allPairs = malloc(sizeof(int) * 2 * (total > 0 ? total : 1));
+    words = malloc(sizeof(uint64_t) * (totalWords > 0 ? totalWords : 1));
+    MPI_Allgatherv(pairs, 2 * local->count, MPI_INT, allPairs, counts, displs, MPI_INT, comm);
+    MPI_Allgatherv(local->words, localWords, MPI_UINT64_T, words, wordCounts, wordDispls, MPI_UINT64_T, comm);
+
+    *allTags = malloc(sizeof(int) * (total > 0 ? total : 1));
+    for (i = 0; i < total; i++) {
+        (*allTags)[i] = allPairs[2 * i];
+        appendPackedStrand(all, words + offset, allPairs[2 * i + 1]);
+        offset += packedWords(allPairs[2 * i + 1]);
+    }
+
+    free(counts);
+    free(displs);
+    free(wordCounts);
+    free(wordDispls);
+    free(pairs);
+    free(allPairs);
+    free(words);
+    return all;
+}
+
+/*
+ * k-means++ over candidate strands of all processes of comm: the master
+ * draws the medoids among them one after the other, each with probability
+ * proportional to the squared edit distance to the nearest one drawn
+ * before, and every process gets the same medoids. strands holds the
+ * strands of this process starting at global index firstRow.
+ */
+StrandArena* seedMedoids(MPI_Comm comm, const StrandArena* strands, int firstRow, int totalRows, int cluster) {
+    int rank;
+    int candidateNums;
+    int* candidates = seedCandidates(totalRows, cluster, &candidateNums);
+    int* tags = malloc(sizeof(int) * candidateNums);
+    int* order = malloc(sizeof(int) * candidateNums);
+    int* picks = malloc(sizeof(int) * cluster);
+    int* allTags;
+    StrandArena* owned = createStrandArena();
+    StrandArena* gathered;
+    StrandArena* medoids = createStrandArena();
+    int i, c;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Bcast(candidates, candidateNums, MPI_INT, 0, comm);
+
+    /* the owner of every candidate hands it to all processes */
+    for (i = 0; i < candidateNums; i++) {
+        int local = candidates[i] - firstRow;
+        if (local >= 0 && local < strands->count) {
+            tags[owned->count] = i;
+            appendPackedStrand(owned, arenaStrand(strands, local), strands->lengths[local]);
+        }
+    }
+    gathered = allgatherStrands(comm, owned, tags, &allTags);
+    for (i = 0; i < gathered->count; i++) {
+        order[allTags[i]] = i;
+    }
+
+    if (rank == 0) {
+        /* the squared distance of every candidate to its nearest medoid so far */
+        double* closest = malloc(sizeof(double) * candidateNums);
+        int maxBlocks = 1;
+        uint64_t* scratch;
+        for (i = 0; i < candidateNums; i++) {
+            closest[i] = -1;
+            maxBlocks = max(maxBlocks, (gathered->lengths[i] + EDIT_BLOCK_BASES - 1) / EDIT_BLOCK_BASES);
+        }
+        scratch = malloc(sizeof(uint64_t) * 3 * maxBlocks);
+        picks[0] = ((int)rand()) % candidateNums;
+        for (c = 0; c < cluster; c++) {
+            EditPattern pattern;
+            double total = 0;
+            const uint64_t* medoid;
+            if (c > 0) {
+                /* a candidate equal to a medoid has no weight, when all are take any */
+                double target;
+                for (i = 0; i < candidateNums; i++) {
+                    total += closest[i];
+                }
+                target = rand() / ((double)RAND_MAX + 1) * total;
+                for (i = 0; i < candidateNums - 1 && (total <= 0 || target >= closest[i]); i++) {
+                    target -= total > 0 ? closest[i] : 0;
+                }
+                picks[c] = total > 0 ? i : ((int)rand()) % candidateNums;
+            }
+            medoid = arenaStrand(gathered, order[picks[c]]);
+            prepareEditPattern(&pattern, medoid, gathered->lengths[order[picks[c]]]);
+            for (i = 0; i < candidateNums; i++) {
+                double distance = editDistance(&pattern, arenaStrand(gathered, order[i]), gathered->lengths[order[i]],
+                                               EDIT_NO_LIMIT, scratch);
+                distance *= distance;
+                closest[i] = closest[i] < 0 || distance < closest[i] ? distance : closest[i];
+            }
+            freeEditPattern(&pattern);
+        }
+        free(closest);
+        free(scratch);
+    }
+    MPI_Bcast(picks, cluster, MPI_INT, 0, comm);
+    for (c = 0; c < cluster; c++) {
+        appendPackedStrand(medoids, arenaStrand(gathered, order[picks[c]]), gathered->lengths[order[picks[c]]]);
+    }
+
+    free(candidates);
+    free(tags);
+    free(order);
+    free(picks);
+    free(allTags);
+    freeStrandArena(owned);
+    freeStrandArena(gathered);
+    return medoids;
+}
+
+/*
+ * every process offers up to perProcess random strands of each cluster,
+ * drawn with reservoir sampling, or all of them in order when perProcess
+ * is 0, tagged with their cluster in tags
+ */
+static StrandArena* offerCandidates(const StrandArena* strands, const int* categories, int cluster, int perProcess,
+                                    unsigned int* seed, int** tags) {
+    int* chosen;
+    int* seen;
+    StrandArena* offered = createStrandArena();
+    int i, c;
+
+    if (perProcess == 0) {
+        *tags = malloc(sizeof(int) * (strands->count > 0 ? strands->count : 1));
+        for (c = 0; c < cluster; c++) {
+            for (i = 0; i < strands->count; i++) {
+                if (categories[i] == c) {
+                    (*tags)[offered->count] = c;
+                    appendPackedStrand(offered, arenaStrand(strands, i), strands->lengths[i]);
+                }
+            }
+        }
+        return offered;
+    }
+    chosen = malloc(sizeof(int) * cluster * perProcess);
+    seen = calloc(cluster, sizeof(int));
+    for (i = 0; i < strands->count; i++) {
+        int category = categories[i];
+        int slot = seen[category] < perProcess ? seen[category] : (int)(rand_r(seed) % (seen[category] + 1));
+        if (slot < perProcess) {
+            chosen[category * perProcess + slot] = i;
+        }
+        seen[category]++;
+    }
+    *tags = malloc(sizeof(int) * cluster * perProcess);
+    for (c = 0; c < cluster; c++) {
+        for (i = 0; i < seen[c] && i < perProcess; i++) {
+            int strand = chosen[c * perProcess + i];
+            (*tags)[offered->count] = c;
+            appendPackedStrand(offered, arenaStrand(strands, strand), strands->lengths[strand]);
+        }
+    }
+    free(chosen);
+    free(seen);
+    return offered;
+}
+
+/*
+ * cluster the strands of all processes of comm around the medoids, which
+ * are the seeds on entry and replaced by the result. The category of every
+ * local strand is stored in categories, which starts out with the category
+ * a strand far from every medoid keeps, and the summed distance of all
+ * strands to their medoids in cost. Returns the number of iterations.
+ */
+int editKMeans(MPI_Comm comm, const StrandArena* strands, int cluster, const KMeansOptions* options,
+               StrandArena** medoids, int* categories, double* cost) {
+    ThreadPool* pool = createThreadPool(options->threads);
+    int threads = poolThreads(pool);
+    int rank, numprocs;
+    int perProcess;
+    unsigned int seed;
+    int iterations = 0;
+    /* once no strand changes cluster every member of a cluster is a candidate,
+     * and the run ends when that leaves the medoids as they are */
+    int exhaustive = 0;
+    int moved = 1;
+    int* candidateFirst = malloc(sizeof(int) * (cluster + 1));
+    EditStep step;
+    int i, c, t;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numprocs);
+    seed = 1 + rank;
+    perProcess = MEDOID_CANDIDATES / numprocs > 0 ? MEDOID_CANDIDATES / numprocs : 1;
+
+    step.strands = strands;
+    step.categories = categories;
+    step.candidateFirst = candidateFirst;
+    step.limit = options->band > 0 ? options->band : EDIT_NO_LIMIT;
+
+    while (1) {
+        double local[2];
+        double global[2];
+        EditPattern* patterns;
+        StrandArena* offered;
+        StrandArena* gathered;
+        StrandArena* candidates;
+        StrandArena* next;
+        int* offeredTags;
+        int* gatheredTags;
+        double* totals;
+        long long distances = 0;
+
+        iterations++;
+        nextIteration();
+
+        /* assignment step - every strand to the nearest medoid */
+        beginPhase(PHASE_ASSIGN);
+        patterns = preparePatterns(*medoids, &step.maxBlocks);
+        step.patterns = patterns;
+        step.patternNums = cluster;
+        step.sums = allocateThreadBlocks(threads, 2, sizeof(double), &step.stride);
+        runThreadPool(pool, assignStrands, &step);
+        local[0] = 0;
+        local[1] = 0;
+        for (t = 0; t < threads; t++) {
+            local[0] += step.sums[(size_t)t * step.stride];
+            local[1] += step.sums[(size_t)t * step.stride + 1];
+        }
+        free(step.sums);
+        freePatterns(patterns, cluster);
+        endPhase(PHASE_ASSIGN);
+        addDistances((long long)strands->count * cluster);
+
+        beginPhase(PHASE_REDUCE);
+        MPI_Allreduce(local, global, 2, MPI_DOUBLE, MPI_SUM, comm);
+        endPhase(PHASE_REDUCE);
+        *cost = global[1];
+
+        /* the first pass starts from made up categories, so it always counts as a change */
+        if (iterations > 1 && global[0] == 0) {
+            if (exhaustive && !moved) {
+                break;
+            }
+            exhaustive = 1;
+        }
+        if (options->maxIterations > 0 && iterations >= options->maxIterations) {
+            break;
+        }
+
+        /* update step - the candidates of every cluster are its old medoid and the strands on offer */
+        beginPhase(PHASE_UPDATE);
+        offered = offerCandidates(strands, categories, cluster, exhaustive ? 0 : perProcess, &seed, &offeredTags);
+        gathered = allgatherStrands(comm, offered, offeredTags, &gatheredTags);
+        candidates = createStrandArena();
+        for (c = 0; c < cluster; c++) {
+            candidateFirst[c] = candidates->count;
+            appendPackedStrand(candidates, arenaStrand(*medoids, c), (*medoids)->lengths[c]);
+            for (i = 0; i < gathered->count; i++) {
+                if (gatheredTags[i] == c) {
+                    appendPackedStrand(candidates, arenaStrand(gathered, i), gathered->lengths[i]);
+                }
+            }
+        }
+        candidateFirst[cluster] = candidates->count;
+        for (i = 0; i < strands->count; i++) {
+            distances += candidateFirst[categories[i] + 1] - candidateFirst[categories[i]];
+        }
+
+        /* the sum of the distances of every candidate to the strands of its cluster on all processes */
+        patterns = preparePatterns(candidates, &step.maxBlocks);
+        step.patterns = patterns;
+        step.patternNums = candidates->count;
+        step.sums = allocateThreadBlocks(threads, candidates->count, sizeof(double), &step.stride);
+        runThreadPool(pool, scoreCandidates, &step);
+        for (t = 1; t < threads; t++) {
+            for (i = 0; i < candidates->count; i++) {
+                step.sums[i] += step.sums[(size_t)t * step.stride + i];
+            }
+        }
+        totals = malloc(sizeof(double) * candidates->count);
+        MPI_Allreduce(step.sums, totals, candidates->count, MPI_DOUBLE, MPI_SUM, comm);
+        addDistances(distances);
+
+        /* the cheapest candidate of every cluster, the old medoid on a tie */
+        next = createStrandArena();
+        moved = 0;
+        for (c = 0; c < cluster; c++) {
+            int best = candidateFirst[c];
+            for (t = candidateFirst[c] + 1; t < candidateFirst[c + 1]; t++) {
+                best = totals[t] < totals[best] ? t : best;
+            }
+            moved |= best != candidateFirst[c];
+            appendPackedStrand(next, arenaStrand(candidates, best), candidates->lengths[best]);
+        }
+        freeStrandArena(*medoids);
+        *medoids = next;
+
+        free(step.sums);
+        free(totals);
+        freePatterns(patterns, candidates->count);
+        freeStrandArena(offered);
+        freeStrandArena(gathered);
+        freeStrandArena(candidates);
+        free(offeredTags);
+        free(gatheredTags);
+        endPhase(PHASE_UPDATE);
+    }
+    endIterations();
+
+    free(candidateFirst);
+    destroyThreadPool(pool);
+    return iterations;
+}
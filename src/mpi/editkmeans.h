@@ -0,0 +1,45 @@
+#ifndef _EDITKMEANS_H_
+#define _EDITKMEANS_H_
+
+#include "mpi.h"
+#include "util.h"
+#include "dnaedit.h"
+
+/*
+ * Clustering of strands of any length by edit distance (see dnaedit.h),
+ * enabled with --variable-length 1. A consensus of strands of different
+ * lengths would need a multiple alignment, so every cluster is represented
+ * by one of its strands, its medoid. Every iteration assigns each strand
+ * to the nearest medoid. Then every process offers a few random strands of
+ * each cluster as candidates, each candidate and the old medoid are scored
+ * by the sum of their edit distances to the strands of the cluster on all
+ * processes, and the cheapest one becomes the new medoid. Once no strand
+ * changes cluster any more, every member of a cluster is a candidate, and
+ * the run ends when no strand and no medoid changes. With --band W
+ * the distances above W are not computed, they count as W + 1, and a
+ * strand farther than W from every medoid stays in its cluster.
+ */
+
+/* the candidates offered for every cluster per iteration, spread over the processes */
+#define MEDOID_CANDIDATES 16
+
+/*
+ * k-means++ over candidate strands of all processes of comm: the master
+ * draws the medoids among them one after the other, each with probability
+ * proportional to the squared edit distance to the nearest one drawn
+ * before, and every process gets the same medoids. strands holds the
+ * strands of this process starting at global index firstRow.
+ */
+StrandArena* seedMedoids(MPI_Comm comm, const StrandArena* strands, int firstRow, int totalRows, int cluster);
+
+/*
+ * cluster the strands of all processes of comm around the medoids, which
+ * are the seeds on entry and replaced by the result. The category of every
+ * local strand is stored in categories, which starts out with the category
+ * a strand far from every medoid keeps, and the summed distance of all
+ * strands to their medoids in cost. Returns the number of iterations.
+ */
+int editKMeans(MPI_Comm comm, const StrandArena* strands, int cluster, const KMeansOptions* options,
+               StrandArena** medoids, int* categories, double* cost);
+
+#endif
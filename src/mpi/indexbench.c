@@ -0,0 +1,83 @@
+/*
+ * Compare the kd-tree of centroidindex.h with the linear scan of
+ * nearestCentroid for a growing number of clusters, to see from which
+ * number of clusters --index kdtree pays off.
+ *
+ * Build: cc -O2 -o indexbench indexbench.c centroidindex.c vecdist.c
+ * Usage: indexbench [dimension] [points]
+ *
+ * The points and centroids are uniform in the unit cube. The tree time
+ * includes one rebuild, as in every k-means iteration.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "centroidindex.h"
+#include "vecdist.h"
+
+/*
+ * the wall clock in seconds
+ */
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void fillUniform(double* values, long count) {
+    long i;
+    for (i = 0; i < count; i++) {
+        values[i] = rand() / (double)RAND_MAX;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int dimension = argc > 1 ? atoi(argv[1]) : 2;
+    int points = argc > 2 ? atoi(argv[2]) : 200000;
+    int clusters[] = {8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096};
+    int clusterNums = sizeof(clusters) / sizeof(clusters[0]);
+    double* rows = malloc(sizeof(double) * points * dimension);
+    int c, i;
+
+    if (dimension < 1 || points < 1) {
+        printf("Usage: indexbench [dimension] [points]\n");
+        exit(-1);
+    }
+    srand(1);
+    fillUniform(rows, (long)points * dimension);
+
+    printf("dimension %d, %d points\n", dimension, points);
+    printf("%8s %12s %12s %8s %10s\n", "clusters", "scan (s)", "kdtree (s)", "speedup", "mismatches");
+    for (c = 0; c < clusterNums; c++) {
+        int cluster = clusters[c];
+        double* centroids = malloc(sizeof(double) * cluster * dimension);
+        int* scanned = malloc(sizeof(int) * points);
+        CentroidIndex* index = createCentroidIndex(cluster, dimension);
+        double start, scanTime, treeTime;
+        int mismatches = 0;
+
+        fillUniform(centroids, (long)cluster * dimension);
+
+        start = now();
+        for (i = 0; i < points; i++) {
+            scanned[i] = nearestCentroid(rows + (size_t)i * dimension, centroids, cluster, dimension, NULL);
+        }
+        scanTime = now() - start;
+
+        start = now();
+        rebuildCentroidIndex(index, centroids);
+        for (i = 0; i < points; i++) {
+            mismatches += nearestIndexedCentroid(index, rows + (size_t)i * dimension, NULL, NULL) != scanned[i];
+        }
+        treeTime = now() - start;
+
+        printf("%8d %12.4f %12.4f %8.2f %10d\n", cluster, scanTime, treeTime, scanTime / treeTime, mismatches);
+        freeCentroidIndex(index);
+        free(centroids);
+        free(scanned);
+    }
+
+    free(rows);
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rebalance.h"
+
+/*
+ * the new row counts: shares of totalRows proportional to speeds, the
+ * boundaries rounded from the running sum so that they add up exactly
+ */
+static void targetRows(const double* speeds, int numprocs, long long totalRows, int* counts) {
+    double sumSpeed = 0;
+    double runningSpeed = 0;
+    long long previous = 0;
+    int p;
+
+    for (p = 0; p < numprocs; p++) {
+        sumSpeed += speeds[p];
+    }
+    for (p = 0; p < numprocs; p++) {
+        long long boundary;
+        runningSpeed += speeds[p];
+        boundary = p + 1 < numprocs ? (long long)(totalRows * (runningSpeed / sumSpeed) + 0.5) : totalRows;
+        counts[p] = (int)(boundary - previous);
+        previous = boundary;
+    }
+}
+
+/*
+ * move rows between the processes of comm in proportion to their speed,
+ * localRows rows of rowBytes each having taken seconds on this process.
+ * rows is replaced by a new buffer and localRows by the new count if any
+ * row moved. Returns whether rows moved, the same on every process.
+ */
+int rebalanceRows(MPI_Comm comm, void** rows, int* localRows, int rowBytes, double seconds) {
+    int rank, numprocs;
+    int p;
+    double measure[2];
+    double* measures;
+    double* speeds;
+    int* counts;
+    int* targets;
+    int* sendCounts;
+    int* sendDispls;
+    int* recvCounts;
+    int* recvDispls;
+    long long totalRows = 0;
+    double sumSpeed = 0;
+    double slowest = 0;
+    int measured = 0;
+    long long oldFirst = 0, newFirst = 0;
+    long long first;
+    MPI_Datatype rowType;
+    void* moved;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numprocs);
+
+    /* the rows and seconds of every process */
+    measure[0] = *localRows;
+    measure[1] = seconds;
+    measures = malloc(sizeof(double) * 2 * numprocs);
+    MPI_Allgather(measure, 2, MPI_DOUBLE, measures, 2, MPI_DOUBLE, comm);
+
+    speeds = malloc(sizeof(double) * numprocs);
+    counts = malloc(sizeof(int) * numprocs);
+    targets = malloc(sizeof(int) * numprocs);
+    for (p = 0; p < numprocs; p++) {
+        counts[p] = (int)measures[2 * p];
+        totalRows += counts[p];
+        speeds[p] = counts[p] > 0 && measures[2 * p + 1] > 0 ? counts[p] / measures[2 * p + 1] : 0;
+        if (speeds[p] > 0) {
+            sumSpeed += speeds[p];
+            measured++;
+        }
+        slowest = measures[2 * p + 1] > slowest ? measures[2 * p + 1] : slowest;
+    }
+    free(measures);
+    if (measured == 0) {
+        free(speeds);
+        free(counts);
+        free(targets);
+        return 0;
+    }
+    /* a process without rows has not shown its speed, it is taken as an average one */
+    for (p = 0; p < numprocs; p++) {
+        if (speeds[p] == 0) {
+            speeds[p] = sumSpeed / measured;
+        }
+    }
+    for (p = 0, sumSpeed = 0; p < numprocs; p++) {
+        sumSpeed += speeds[p];
+    }
+
+    /* moving rows costs time as well, so only a clear imbalance is worth it */
+    if (slowest <= totalRows / sumSpeed * (1 + REBALANCE_TOLERANCE)) {
+        free(speeds);
+        free(counts);
+        free(targets);
+        return 0;
+    }
+    targetRows(speeds, numprocs, totalRows, targets);
+
+    for (p = 0; p < rank; p++) {
+        oldFirst += counts[p];
+        newFirst += targets[p];
+    }
+
+    /* send the part of the old range that falls into the new range of every process, receive the reverse */
+    sendCounts = malloc(sizeof(int) * numprocs);
+    sendDispls = malloc(sizeof(int) * numprocs);
+    recvCounts = malloc(sizeof(int) * numprocs);
+    recvDispls = malloc(sizeof(int) * numprocs);
+    for (p = 0, first = 0; p < numprocs; first += targets[p], p++) {
+        long long begin = first > oldFirst ? first : oldFirst;
+        long long end = first + targets[p] < oldFirst + *localRows ? first + targets[p] : oldFirst + *localRows;
+        sendCounts[p] = end > begin ? (int)(end - begin) : 0;
+        sendDispls[p] = end > begin ? (int)(begin - oldFirst) : 0;
+    }
+    for (p = 0, first = 0; p < numprocs; first += counts[p], p++) {
+        long long begin = first > newFirst ? first : newFirst;
+        long long end = first + counts[p] < newFirst + targets[rank] ? first + counts[p] : newFirst + targets[rank];
+        recvCounts[p] = end > begin ? (int)(end - begin) : 0;
+        recvDispls[p] = end > begin ? (int)(begin - newFirst) : 0;
+    }
+
+    /* whole rows travel as one element each, so the counts stay small */
+    MPI_Type_contiguous(rowBytes, MPI_BYTE, &rowType);
+    MPI_Type_commit(&rowType);
+    moved = malloc((size_t)(targets[rank] > 0 ? targets[rank] : 1) * rowBytes);
+    MPI_Alltoallv(*rows, sendCounts, sendDispls, rowType, moved, recvCounts, recvDispls, rowType, comm);
+    MPI_Type_free(&rowType);
+
+    free(*rows);
+    *rows = moved;
+    *localRows = targets[rank];
+
+    free(speeds);
+    free(counts);
+    free(targets);
+    free(sendCounts);
+    free(sendDispls);
+    free(recvCounts);
+    free(recvDispls);
+    return 1;
+}
@@ -0,0 +1,28 @@
+#ifndef _REBALANCE_H_
+#define _REBALANCE_H_
+
+#include "mpi.h"
+
+/*
+ * Dynamic partitioning for nodes of different speeds. Every process holds
+ * a contiguous range of the rows, in rank order. After the first
+ * iterations every process reports how many rows it assigned per second,
+ * each one gets a share of the rows proportional to its speed, and the
+ * rows move to their new owners. The ranges stay contiguous and in rank
+ * order, so rows only travel between processes whose old and new ranges
+ * overlap, which is usually a neighbour, and the labels keep the order of
+ * the input.
+ */
+
+/* predicted imbalances below this fraction of the iteration time are left alone */
+#define REBALANCE_TOLERANCE 0.05
+
+/*
+ * move rows between the processes of comm in proportion to their speed,
+ * localRows rows of rowBytes each having taken seconds on this process.
+ * rows is replaced by a new buffer and localRows by the new count if any
+ * row moved. Returns whether rows moved, the same on every process.
+ */
+int rebalanceRows(MPI_Comm comm, void** rows, int* localRows, int rowBytes, double seconds);
+
+#endif
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include "restarts.h"
+#include "util.h"
+
+/*
+ * split comm into restarts groups of neighbouring ranks, there must be at
+ * least as many processes. The index of the group of this process is
+ * stored in restart.
+ */
+MPI_Comm splitRestarts(MPI_Comm comm, int restarts, int* restart) {
+    int rank, numprocs;
+    MPI_Comm group;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numprocs);
+    *restart = (int)((long long)rank * restarts / numprocs);
+    MPI_Comm_split(comm, *restart, rank, &group);
+    return group;
+}
+
+/*
+ * give every group of comm all the rows: the localRows rows of rowBytes
+ * each this process holds, a contiguous range in rank order, move so that
+ * every process holds its share of them within group (see partitionRows).
+ * Frees rows, returns the new rows and stores their count in localRows.
+ */
+void* replicateRows(MPI_Comm comm, MPI_Comm group, void* rows, int* localRows, int rowBytes) {
+    int rank, numprocs;
+    int place[2];
+    int* places;
+    int* counts;
+    int* sendCounts;
+    int* sendDispls;
+    int* recvCounts;
+    int* recvDispls;
+    int totalRows = 0;
+    int oldFirst = 0;
+    int newFirst, newRows;
+    int first, p;
+    MPI_Datatype rowType;
+    void* copied;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numprocs);
+
+    /* the rows every process holds now, and its rank and size within its group */
+    MPI_Comm_rank(group, &place[0]);
+    MPI_Comm_size(group, &place[1]);
+    places = malloc(sizeof(int) * 2 * numprocs);
+    counts = malloc(sizeof(int) * numprocs);
+    MPI_Allgather(place, 2, MPI_INT, places, 2, MPI_INT, comm);
+    MPI_Allgather(localRows, 1, MPI_INT, counts, 1, MPI_INT, comm);
+    for (p = 0; p < numprocs; p++) {
+        oldFirst += p < rank ? counts[p] : 0;
+        totalRows += counts[p];
+    }
+    partitionRows(totalRows, place[1], place[0], &newFirst, &newRows);
+
+    /* send the part of the old range that falls into the new range of every process, receive the reverse */
+    sendCounts = malloc(sizeof(int) * numprocs);
+    sendDispls = malloc(sizeof(int) * numprocs);
+    recvCounts = malloc(sizeof(int) * numprocs);
+    recvDispls = malloc(sizeof(int) * numprocs);
+    for (p = 0, first = 0; p < numprocs; first += counts[p], p++) {
+        int targetFirst, targetRows;
+        int begin, end;
+        partitionRows(totalRows, places[2 * p + 1], places[2 * p], &targetFirst, &targetRows);
+        begin = targetFirst > oldFirst ? targetFirst : oldFirst;
+        end = targetFirst + targetRows < oldFirst + *localRows ? targetFirst + targetRows : oldFirst + *localRows;
+        sendCounts[p] = end > begin ? end - begin : 0;
+        sendDispls[p] = end > begin ? begin - oldFirst : 0;
+
+        begin = first > newFirst ? first : newFirst;
+        end = first + counts[p] < newFirst + newRows ? first + counts[p] : newFirst + newRows;
+        recvCounts[p] = end > begin ? end - begin : 0;
+        recvDispls[p] = end > begin ? begin - newFirst : 0;
+    }
+
+    /* whole rows travel as one element each, so the counts stay small */
+    MPI_Type_contiguous(rowBytes, MPI_BYTE, &rowType);
+    MPI_Type_commit(&rowType);
+    copied = malloc((size_t)(newRows > 0 ? newRows : 1) * rowBytes);
+    MPI_Alltoallv(rows, sendCounts, sendDispls, rowType, copied, recvCounts, recvDispls, rowType, comm);
+    MPI_Type_free(&rowType);
+
+    free(rows);
+    *localRows = newRows;
+
+    free(places);
+    free(counts);
+    free(sendCounts);
+    free(sendDispls);
+    free(recvCounts);
+    free(recvDispls);
+    return copied;
+}
+
+/*
+ * the restart with the lowest cost, the same on every process of comm.
+ * localCost is the cost of the rows of this process, the cost of its
+ * whole group is stored in cost.
+ */
+int bestRestart(MPI_Comm comm, MPI_Comm group, int restart, double localCost, double* cost) {
+    struct {
+        double cost;
+        int restart;
+    } candidate, best;
+
+    MPI_Allreduce(&localCost, cost, 1, MPI_DOUBLE, MPI_SUM, group);
+    candidate.cost = *cost;
+    candidate.restart = restart;
+    /* ties go to the lower restart */
+    MPI_Allreduce(&candidate, &best, 1, MPI_DOUBLE_INT, MPI_MINLOC, comm);
+    return best.restart;
+}
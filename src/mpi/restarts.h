@@ -0,0 +1,36 @@
+#ifndef _RESTARTS_H_
+#define _RESTARTS_H_
+
+#include "mpi.h"
+
+/*
+ * Several independently seeded runs in one job, enabled with --restarts R.
+ * The processes are split into R groups of neighbouring ranks, each group
+ * gets a copy of all the rows spread over its processes, so the file is
+ * only read once, and runs k-means on its own communicator. In the end the
+ * run with the lowest cost is kept.
+ */
+
+/*
+ * split comm into restarts groups of neighbouring ranks, there must be at
+ * least as many processes. The index of the group of this process is
+ * stored in restart.
+ */
+MPI_Comm splitRestarts(MPI_Comm comm, int restarts, int* restart);
+
+/*
+ * give every group of comm all the rows: the localRows rows of rowBytes
+ * each this process holds, a contiguous range in rank order, move so that
+ * every process holds its share of them within group (see partitionRows).
+ * Frees rows, returns the new rows and stores their count in localRows.
+ */
+void* replicateRows(MPI_Comm comm, MPI_Comm group, void* rows, int* localRows, int rowBytes);
+
+/*
+ * the restart with the lowest cost, the same on every process of comm.
+ * localCost is the cost of the rows of this process, the cost of its
+ * whole group is stored in cost.
+ */
+int bestRestart(MPI_Comm comm, MPI_Comm group, int restart, double localCost, double* cost);
+
+#endif
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rowstream.h"
+#include "util.h"
+
+struct RowStream {
+    MPI_File file;
+    int rowBytes;
+    int firstRow;
+    int rows;
+    int chunkRows;
+    /* the chunk being read into each buffer and its pending read */
+    void* buffers[2];
+    int chunkStart[2];
+    MPI_Request requests[2];
+    /* the buffer handed out by the last nextRowChunk */
+    int current;
+    /* the first local row not yet asked to be read */
+    int nextStart;
+};
+
+/*
+ * start reading the next chunk into buffer, if any rows are left
+ */
+static void readAhead(RowStream* stream, int buffer) {
+    int start = stream->nextStart;
+    int count = stream->rows - start < stream->chunkRows ? stream->rows - start : stream->chunkRows;
+    MPI_Offset offset = (MPI_Offset)sizeof(DatasetHeader) + (MPI_Offset)(stream->firstRow + start) * stream->rowBytes;
+
+    stream->chunkStart[buffer] = start;
+    if (count <= 0) {
+        stream->requests[buffer] = MPI_REQUEST_NULL;
+        return;
+    }
+    MPI_File_iread_at(stream->file, offset, stream->buffers[buffer], count * stream->rowBytes, MPI_BYTE,
+                      &stream->requests[buffer]);
+    stream->nextStart += count;
+}
+
+/*
+ * open the rows of this process of comm, chunkRows rows at a time
+ */
+RowStream* openRowStream(MPI_Comm comm, const char* filename, const DatasetHeader* header, int chunkRows) {
+    RowStream* stream = malloc(sizeof(RowStream));
+    int rank, numprocs;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numprocs);
+    partitionRows((int)header->rows, numprocs, rank, &stream->firstRow, &stream->rows);
+    stream->rowBytes = datasetRowBytes(header);
+    /* a chunk is read with a single call, whose count is an int */
+    if ((long long)chunkRows * stream->rowBytes > 2147483647LL) {
+        chunkRows = 2147483647 / stream->rowBytes;
+    }
+    stream->chunkRows = chunkRows;
+
+    /* every process reads its own rows on its own */
+    if (MPI_File_open(MPI_COMM_SELF, (char*)filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &stream->file) != MPI_SUCCESS) {
+        printf("Cannot open file %s\n", filename);
+        MPI_Abort(comm, 1);
+    }
+    stream->buffers[0] = malloc((size_t)chunkRows * stream->rowBytes);
+    stream->buffers[1] = malloc((size_t)chunkRows * stream->rowBytes);
+    stream->requests[0] = MPI_REQUEST_NULL;
+    stream->requests[1] = MPI_REQUEST_NULL;
+    stream->current = 1;
+    stream->nextStart = stream->rows;
+    return stream;
+}
+
+/*
+ * the number of rows of this process and the global index of the first one
+ */
+int streamRows(const RowStream* stream, int* firstRow) {
+    *firstRow = stream->firstRow;
+    return stream->rows;
+}
+
+/*
+ * start a new pass over the rows
+ */
+void rewindRowStream(RowStream* stream) {
+    /* a pass left early may still have reads in flight */
+    MPI_Waitall(2, stream->requests, MPI_STATUSES_IGNORE);
+    stream->nextStart = 0;
+    stream->current = 1;
+    readAhead(stream, 0);
+}
+
+/*
+ * the next chunk of the pass, or NULL when the pass is done. The chunk
+ * stays valid until the next call. The local index of its first row is
+ * stored in first and its number of rows in count.
+ */
+const void* nextRowChunk(RowStream* stream, int* first, int* count) {
+    int buffer = 1 - stream->current;
+
+    if (stream->requests[buffer] == MPI_REQUEST_NULL) {
+        return NULL;
+    }
+    MPI_Wait(&stream->requests[buffer], MPI_STATUS_IGNORE);
+    /* the caller is done with the other buffer, so the read after this chunk can go there */
+    stream->current = buffer;
+    readAhead(stream, 1 - buffer);
+
+    *first = stream->chunkStart[buffer];
+    *count = stream->rows - *first < stream->chunkRows ? stream->rows - *first : stream->chunkRows;
+    return stream->buffers[buffer];
+}
+
+void closeRowStream(RowStream* stream) {
+    MPI_Waitall(2, stream->requests, MPI_STATUSES_IGNORE);
+    MPI_File_close(&stream->file);
+    free(stream->buffers[0]);
+    free(stream->buffers[1]);
+    free(stream);
+}
+
+/*
+ * create the label file prefix.<rank> of this process
+ */
+MPI_File openSpillFile(const char* prefix, int rank) {
+    char* name = malloc(strlen(prefix) + 16);
+    MPI_File file;
+
+    sprintf(name, "%s.%d", prefix, rank);
+    if (MPI_File_open(MPI_COMM_SELF, name, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        printf("Cannot create file %s\n", name);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    /* a shorter run must not leave labels of an earlier one behind */
+    MPI_File_set_size(file, 0);
+    free(name);
+    return file;
+}
+
+/*
+ * create the binary label file filename shared by the processes of comm,
+ * seen by this process from the label of its global row firstRow on, so
+ * the local offsets the stream engines write at land in place
+ */
+MPI_File openLabelFile(MPI_Comm comm, const char* filename, int firstRow) {
+    MPI_File file;
+
+    if (MPI_File_open(comm, (char*)filename, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        printf("Cannot create file %s\n", filename);
+        MPI_Abort(comm, 1);
+    }
+    MPI_File_set_size(file, 0);
+    MPI_File_set_view(file, (MPI_Offset)firstRow * sizeof(int), MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+    return file;
+}
+
+/*
+ * read the rows with the given global indices of a binary data set into
+ * result, without the rest of the file
+ */
+void readDatasetRows(const char* filename, const DatasetHeader* header, const int* indices, int count, void* result) {
+    int rowBytes = datasetRowBytes(header);
+    MPI_File file;
+    int i;
+
+    if (MPI_File_open(MPI_COMM_SELF, (char*)filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        printf("Cannot open file %s\n", filename);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (i = 0; i < count; i++) {
+        MPI_Offset offset = (MPI_Offset)sizeof(DatasetHeader) + (MPI_Offset)indices[i] * rowBytes;
+        MPI_File_read_at(file, offset, (char*)result + (size_t)i * rowBytes, rowBytes, MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+    MPI_File_close(&file);
+}
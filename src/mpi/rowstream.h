@@ -0,0 +1,60 @@
+#ifndef _ROWSTREAM_H_
+#define _ROWSTREAM_H_
+
+#include "mpi.h"
+#include "dataset.h"
+
+/*
+ * Out-of-core access to the rows of a binary data set. A RowStream walks
+ * this process's rows (see partitionRows) in chunks of a fixed number of
+ * rows with two buffers: while the caller works on one chunk, the next one
+ * is read into the other buffer with MPI_File_iread_at. Only the two
+ * buffers are kept in memory, so a pass can be repeated every iteration
+ * for data sets larger than the memory of the processes.
+ */
+
+typedef struct RowStream RowStream;
+
+/*
+ * open the rows of this process of comm, chunkRows rows at a time
+ */
+RowStream* openRowStream(MPI_Comm comm, const char* filename, const DatasetHeader* header, int chunkRows);
+
+/*
+ * the number of rows of this process and the global index of the first one
+ */
+int streamRows(const RowStream* stream, int* firstRow);
+
+/*
+ * start a new pass over the rows
+ */
+void rewindRowStream(RowStream* stream);
+
+/*
+ * the next chunk of the pass, or NULL when the pass is done. The chunk
+ * stays valid until the next call. The local index of its first row is
+ * stored in first and its number of rows in count.
+ */
+const void* nextRowChunk(RowStream* stream, int* first, int* count);
+
+void closeRowStream(RowStream* stream);
+
+/*
+ * create the label file prefix.<rank> of this process
+ */
+MPI_File openSpillFile(const char* prefix, int rank);
+
+/*
+ * create the binary label file filename shared by the processes of comm,
+ * seen by this process from the label of its global row firstRow on, so
+ * the local offsets the stream engines write at land in place
+ */
+MPI_File openLabelFile(MPI_Comm comm, const char* filename, int firstRow);
+
+/*
+ * read the rows with the given global indices of a binary data set into
+ * result, without the rest of the file
+ */
+void readDatasetRows(const char* filename, const DatasetHeader* header, const int* indices, int count, void* result);
+
+#endif
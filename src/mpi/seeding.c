@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "seeding.h"
+#include "dataio.h"
+#include "vecdist.h"
+#include "dnapack.h"
+
+/*
+ * RowDistance for double vectors
+ */
+double vectorSeedDistance(const void* a, const void* b, int length) {
+    return squaredDistance(a, b, length);
+}
+
+/*
+ * RowDistance for float vectors
+ */
+double singleSeedDistance(const void* a, const void* b, int length) {
+    return squaredDistanceSingle(a, b, length);
+}
+
+/*
+ * RowDistance for packed DNA strands
+ */
+double dnaSeedDistance(const void* a, const void* b, int length) {
+    double distance = packedDNADistance(a, b, length);
+    return distance * distance;
+}
+
+/*
+ * draw a row with probability proportional to its weight times its
+ * distance, either may be NULL for all ones. When every row has a zero
+ * product, e.g. there are fewer distinct rows than clusters, any row is
+ * drawn.
+ */
+static int drawRow(const double* weights, const double* closest, int rowNums) {
+    double total = 0;
+    double target;
+    int i;
+
+    for (i = 0; i < rowNums; i++) {
+        total += (weights == NULL ? 1 : weights[i]) * (closest == NULL ? 1 : closest[i]);
+    }
+    if (total <= 0) {
+        return rand() % rowNums;
+    }
+    target = rand() / ((double)RAND_MAX + 1) * total;
+    for (i = 0; i < rowNums; i++) {
+        target -= (weights == NULL ? 1 : weights[i]) * (closest == NULL ? 1 : closest[i]);
+        if (target < 0) {
+            return i;
+        }
+    }
+    /* the rounding of the sums can leave a bit of the target */
+    return rowNums - 1;
+}
+
+/*
+ * k-means++ among the candidateNums rows of candidates, each one counting
+ * weights[i] times or once if weights is NULL. The cluster seeds are
+ * copied into centroids.
+ */
+void kmeansPlusPlus(const void* candidates, const double* weights, int candidateNums, int rowBytes, int length,
+                    RowDistance distance, int cluster, void* centroids) {
+    memcpy(centroids, (const unsigned char*)candidates + (size_t)drawRow(weights, NULL, candidateNums) * rowBytes,
+           rowBytes);
+    extendSeeds(candidates, weights, candidateNums, rowBytes, length, distance, 1, cluster, centroids);
+}
+
+/*
+ * k-means++ that keeps the first seeded seeds in centroids and draws the
+ * rest up to cluster against them
+ */
+void extendSeeds(const void* candidates, const double* weights, int candidateNums, int rowBytes, int length,
+                 RowDistance distance, int seeded, int cluster, void* centroids) {
+    const unsigned char* candidateRows = candidates;
+    unsigned char* seeds = centroids;
+    /* the distance of every candidate to its closest seed so far */
+    double* closest = malloc(sizeof(double) * candidateNums);
+    int i, c;
+
+    for (i = 0; i < candidateNums; i++) {
+        closest[i] = distance(candidateRows + (size_t)i * rowBytes, seeds, length);
+        for (c = 1; c < seeded; c++) {
+            double d = distance(candidateRows + (size_t)i * rowBytes, seeds + (size_t)c * rowBytes, length);
+            if (d < closest[i]) {
+                closest[i] = d;
+            }
+        }
+    }
+
+    for (c = seeded; c < cluster; c++) {
+        unsigned char* seed = seeds + (size_t)c * rowBytes;
+        memcpy(seed, candidateRows + (size_t)drawRow(weights, closest, candidateNums) * rowBytes, rowBytes);
+        for (i = 0; i < candidateNums; i++) {
+            double d = distance(candidateRows + (size_t)i * rowBytes, seed, length);
+            if (d < closest[i]) {
+                closest[i] = d;
+            }
+        }
+    }
+
+    free(closest);
+}
+
+/*
+ * k-means|| over the rows of all processes of comm. rows holds the
+ * localRows rows of this process starting at global index firstRow, out of
+ * totalRows. Every process gets the same seeds in centroids.
+ */
+void kmeansParallel(MPI_Comm comm, const void* rows, int localRows, int firstRow, int totalRows, int rowBytes,
+                    int length, RowDistance distance, int cluster, void* centroids) {
+    const unsigned char* localContents = rows;
+    int rank, numprocs;
+    int i, p, round;
+    int first;
+    unsigned int seed;
+
+    /* the distance of every local row to its closest sample and the index of that sample */
+    double* closest = malloc(sizeof(double) * localRows);
+    int* nearest = malloc(sizeof(int) * localRows);
+
+    /* the rows sampled by all processes, the same on every process */
+    int sampledNums = 1;
+    int sampledCapacity = 1 + SEED_ROUNDS * SEED_OVERSAMPLING * cluster;
+    unsigned char* sampled = malloc((size_t)sampledCapacity * rowBytes);
+    /* the rows this process samples in one round */
+    int pickedNums;
+    int pickedCapacity = SEED_OVERSAMPLING * cluster;
+    unsigned char* picked = malloc((size_t)pickedCapacity * rowBytes);
+    /* the sampled bytes of every process in one round and where they go */
+    int* pickedCounts;
+    int* pickedDispls;
+    double* weights;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numprocs);
+    pickedCounts = malloc(sizeof(int) * numprocs);
+    pickedDispls = malloc(sizeof(int) * numprocs);
+    seed = 1 + rank;
+
+    /* the first sample is a uniformly drawn row */
+    if (rank == 0) {
+        first = rand() % totalRows;
+    }
+    MPI_Bcast(&first, 1, MPI_INT, 0, comm);
+    fetchRows(comm, 0, &first, 1, rows, firstRow, localRows, rowBytes, sampled);
+    MPI_Bcast(sampled, rowBytes, MPI_BYTE, 0, comm);
+    for (i = 0; i < localRows; i++) {
+        closest[i] = distance(localContents + (size_t)i * rowBytes, sampled, length);
+        nearest[i] = 0;
+    }
+
+    for (round = 0; round < SEED_ROUNDS; round++) {
+        double localCost = 0;
+        double cost;
+        int roundNums;
+
+        for (i = 0; i < localRows; i++) {
+            localCost += closest[i];
+        }
+        MPI_Allreduce(&localCost, &cost, 1, MPI_DOUBLE, MPI_SUM, comm);
+        /* every row is a sample already */
+        if (cost <= 0) {
+            break;
+        }
+
+        /* each row is sampled on its own with probability oversampling * cluster * closest / cost */
+        pickedNums = 0;
+        for (i = 0; i < localRows; i++) {
+            if (rand_r(&seed) / ((double)RAND_MAX + 1) * cost < SEED_OVERSAMPLING * cluster * closest[i]) {
+                if (pickedNums == pickedCapacity) {
+                    pickedCapacity *= 2;
+                    picked = realloc(picked, (size_t)pickedCapacity * rowBytes);
+                }
+                memcpy(picked + (size_t)pickedNums * rowBytes, localContents + (size_t)i * rowBytes, rowBytes);
+                pickedNums++;
+            }
+        }
+
+        /* every process appends the samples of all processes */
+        MPI_Allgather(&pickedNums, 1, MPI_INT, pickedCounts, 1, MPI_INT, comm);
+        roundNums = 0;
+        for (p = 0; p < numprocs; p++) {
+            roundNums += pickedCounts[p];
+        }
+        if (sampledNums + roundNums > sampledCapacity) {
+            sampledCapacity = sampledNums + roundNums;
+            sampled = realloc(sampled, (size_t)sampledCapacity * rowBytes);
+        }
+        for (p = 0; p < numprocs; p++) {
+            pickedDispls[p] = p == 0 ? 0 : pickedDispls[p - 1] + pickedCounts[p - 1];
+        }
+        for (p = 0; p < numprocs; p++) {
+            pickedCounts[p] *= rowBytes;
+            pickedDispls[p] *= rowBytes;
+        }
+        MPI_Allgatherv(picked, pickedNums * rowBytes, MPI_BYTE, sampled + (size_t)sampledNums * rowBytes,
+                       pickedCounts, pickedDispls, MPI_BYTE, comm);
+
+        /* only the new samples can be closer */
+        for (i = 0; i < localRows; i++) {
+            const unsigned char* row = localContents + (size_t)i * rowBytes;
+            for (p = sampledNums; p < sampledNums + roundNums; p++) {
+                double d = distance(row, sampled + (size_t)p * rowBytes, length);
+                if (d < closest[i]) {
+                    closest[i] = d;
+                    nearest[i] = p;
+                }
+            }
+        }
+        sampledNums += roundNums;
+    }
+
+    /* each sample weighs as many rows as it is the closest sample of */
+    weights = calloc(sampledNums, sizeof(double));
+    for (i = 0; i < localRows; i++) {
+        weights[nearest[i]]++;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, weights, sampledNums, MPI_DOUBLE, MPI_SUM, comm);
+
+    /* the master reduces the samples to the seeds */
+    if (rank == 0) {
+        kmeansPlusPlus(sampled, weights, sampledNums, rowBytes, length, distance, cluster, centroids);
+    }
+    MPI_Bcast(centroids, cluster * rowBytes, MPI_BYTE, 0, comm);
+
+    free(closest);
+    free(nearest);
+    free(sampled);
+    free(picked);
+    free(pickedCounts);
+    free(pickedDispls);
+    free(weights);
+}
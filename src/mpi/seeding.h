@@ -0,0 +1,65 @@
+#ifndef _SEEDING_H_
+#define _SEEDING_H_
+
+#include "mpi.h"
+
+/*
+ * D² seeding for both engines. The rows are opaque, rowBytes long, and are
+ * compared with a RowDistance: squared Euclidean for vectors, the squared
+ * Hamming distance for packed DNA. k-means++ picks the seeds one after the
+ * other among rows on one process. k-means|| samples about twice the
+ * number of clusters per round from the rows of every process, weights the
+ * samples by the rows closest to them and reduces them to the seeds with a
+ * weighted k-means++.
+ */
+
+/* the rounds of k-means|| sampling */
+#define SEED_ROUNDS 5
+/* the rows expected to be sampled per round, as a multiple of the number of clusters */
+#define SEED_OVERSAMPLING 2
+
+/*
+ * the squared distance between two rows, length is the dimension of a
+ * vector or the number of words of a packed strand
+ */
+typedef double (*RowDistance)(const void* a, const void* b, int length);
+
+/*
+ * RowDistance for double vectors
+ */
+double vectorSeedDistance(const void* a, const void* b, int length);
+
+/*
+ * RowDistance for float vectors
+ */
+double singleSeedDistance(const void* a, const void* b, int length);
+
+/*
+ * RowDistance for packed DNA strands
+ */
+double dnaSeedDistance(const void* a, const void* b, int length);
+
+/*
+ * k-means++ among the candidateNums rows of candidates, each one counting
+ * weights[i] times or once if weights is NULL. The cluster seeds are
+ * copied into centroids.
+ */
+void kmeansPlusPlus(const void* candidates, const double* weights, int candidateNums, int rowBytes, int length,
+                    RowDistance distance, int cluster, void* centroids);
+
+/*
+ * k-means++ that keeps the first seeded seeds in centroids and draws the
+ * rest up to cluster against them
+ */
+void extendSeeds(const void* candidates, const double* weights, int candidateNums, int rowBytes, int length,
+                 RowDistance distance, int seeded, int cluster, void* centroids);
+
+/*
+ * k-means|| over the rows of all processes of comm. rows holds the
+ * localRows rows of this process starting at global index firstRow, out of
+ * totalRows. Every process gets the same seeds in centroids.
+ */
+void kmeansParallel(MPI_Comm comm, const void* rows, int localRows, int firstRow, int totalRows, int rowBytes,
+                    int length, RowDistance distance, int cluster, void* centroids);
+
+#endif
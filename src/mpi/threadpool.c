@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "threadpool.h"
+
+typedef struct {
+    ThreadPool* pool;
+    int thread;
+} Worker;
+
+struct ThreadPool {
+    int threads;
+    pthread_t* handles;
+    Worker* workers;
+    pthread_mutex_t lock;
+    /* signalled when a new task is posted and when the last worker finishes it */
+    pthread_cond_t posted;
+    pthread_cond_t finished;
+    ThreadTask task;
+    void* arg;
+    /* counts the posted tasks so that a worker runs each one once */
+    unsigned long generation;
+    /* the workers still running the current task */
+    int running;
+    int stop;
+};
+
+static void* workerLoop(void* argument) {
+    Worker* worker = argument;
+    ThreadPool* pool = worker->pool;
+    unsigned long seen = 0;
+
+    while (1) {
+        ThreadTask task;
+        void* arg;
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen && !pool->stop) {
+            pthread_cond_wait(&pool->posted, &pool->lock);
+        }
+        if (pool->stop) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        seen = pool->generation;
+        task = pool->task;
+        arg = pool->arg;
+        pthread_mutex_unlock(&pool->lock);
+
+        task(arg, worker->thread, pool->threads);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) {
+            pthread_cond_signal(&pool->finished);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+/*
+ * start threads - 1 workers, with one thread the tasks run inline
+ */
+ThreadPool* createThreadPool(int threads) {
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    int i;
+
+    pool->threads = threads < 1 ? 1 : threads;
+    pool->handles = malloc(sizeof(pthread_t) * pool->threads);
+    pool->workers = malloc(sizeof(Worker) * pool->threads);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->posted, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+
+    for (i = 1; i < pool->threads; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].thread = i;
+        pthread_create(&pool->handles[i], NULL, workerLoop, &pool->workers[i]);
+    }
+    return pool;
+}
+
+/*
+ * run task on every thread of the pool and wait for all of them
+ */
+void runThreadPool(ThreadPool* pool, ThreadTask task, void* arg) {
+    if (pool->threads == 1) {
+        task(arg, 0, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->arg = arg;
+    pool->running = pool->threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->posted);
+    pthread_mutex_unlock(&pool->lock);
+
+    task(arg, 0, pool->threads);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->finished, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * the number of threads of the pool
+ */
+int poolThreads(const ThreadPool* pool) {
+    return pool->threads;
+}
+
+/*
+ * stop and join the workers
+ */
+void destroyThreadPool(ThreadPool* pool) {
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->posted);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 1; i < pool->threads; i++) {
+        pthread_join(pool->handles[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->posted);
+    pthread_cond_destroy(&pool->finished);
+    free(pool->handles);
+    free(pool->workers);
+    free(pool);
+}
+
+/*
+ * the rows [begin, end) of thread out of threads
+ */
+void threadRows(int rows, int thread, int threads, int* begin, int* end) {
+    *begin = (int)((long long)rows * thread / threads);
+    *end = (int)((long long)rows * (thread + 1) / threads);
+}
+
+/*
+ * count elements of size bytes rounded up to whole cache lines
+ */
+int paddedCount(int count, int size) {
+    int bytes = (count * size + CACHE_LINE_BYTES - 1) / CACHE_LINE_BYTES * CACHE_LINE_BYTES;
+    return bytes / size;
+}
+
+/*
+ * threads blocks of count elements of size bytes, each starting on its
+ * own cache line and zeroed, stride elements apart
+ */
+void* allocateThreadBlocks(int threads, int count, int size, int* stride) {
+    void* blocks;
+    size_t bytes;
+
+    *stride = paddedCount(count, size);
+    bytes = (size_t)threads * *stride * size;
+    if (posix_memalign(&blocks, CACHE_LINE_BYTES, bytes) != 0) {
+        return NULL;
+    }
+    memset(blocks, 0, bytes);
+    return blocks;
+}
@@ -0,0 +1,56 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+/*
+ * A fixed set of threads inside one process. runThreadPool hands the same
+ * task to every thread, the calling thread included as thread 0, and
+ * returns once all of them are done. Only the calling thread talks to MPI.
+ */
+
+/* the accumulators of different threads never share a cache line */
+#define CACHE_LINE_BYTES 64
+
+/*
+ * the work of one thread out of threads
+ */
+typedef void (*ThreadTask)(void* arg, int thread, int threads);
+
+typedef struct ThreadPool ThreadPool;
+
+/*
+ * start threads - 1 workers, with one thread the tasks run inline
+ */
+ThreadPool* createThreadPool(int threads);
+
+/*
+ * run task on every thread of the pool and wait for all of them
+ */
+void runThreadPool(ThreadPool* pool, ThreadTask task, void* arg);
+
+/*
+ * the number of threads of the pool
+ */
+int poolThreads(const ThreadPool* pool);
+
+/*
+ * stop and join the workers
+ */
+void destroyThreadPool(ThreadPool* pool);
+
+/*
+ * the rows [begin, end) of thread out of threads
+ */
+void threadRows(int rows, int thread, int threads, int* begin, int* end);
+
+/*
+ * count elements of size bytes rounded up to whole cache lines
+ */
+int paddedCount(int count, int size);
+
+/*
+ * threads blocks of count elements of size bytes, each starting on its
+ * own cache line and zeroed, stride elements apart
+ */
+void* allocateThreadBlocks(int threads, int count, int size, int* stride);
+
+#endif
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "timing.h"
+
+/* every slot holds the seconds of each phase followed by the distance count */
+#define SLOT_VALUES (PHASE_COUNT + 1)
+
+static const char* phaseNames[PHASE_COUNT] = {
+    "read", "seed", "assign", "accumulate", "reduce", "update", "gather"
+};
+
+static int enabled = 0;
+static double* slots = NULL;
+static int slotNums = 0;
+static int slotCapacity = 0;
+static int current = 0;
+static double phaseStarts[PHASE_COUNT];
+
+/*
+ * start recording on this process
+ */
+void startTiming(void) {
+    enabled = 1;
+    slotCapacity = 64;
+    slots = calloc(slotCapacity * SLOT_VALUES, sizeof(double));
+    slotNums = 1;
+    current = 0;
+}
+
+/*
+ * the current time in seconds, safe to call from any thread
+ */
+double timerNow(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+void beginPhase(int phase) {
+    if (enabled) {
+        phaseStarts[phase] = timerNow();
+    }
+}
+
+void endPhase(int phase) {
+    if (enabled) {
+        slots[current * SLOT_VALUES + phase] += timerNow() - phaseStarts[phase];
+    }
+}
+
+/*
+ * add seconds measured elsewhere to a phase of the current slot
+ */
+void addPhaseSeconds(int phase, double seconds) {
+    if (enabled) {
+        slots[current * SLOT_VALUES + phase] += seconds;
+    }
+}
+
+/*
+ * add the distance computations of this process
+ */
+void addDistances(long long distances) {
+    if (enabled) {
+        slots[current * SLOT_VALUES + PHASE_COUNT] += (double)distances;
+    }
+}
+
+/*
+ * the threads run side by side, so a pass takes as long as its slowest
+ * thread: adds the longest assign and accumulate times and all distances.
+ * Returns the time of the slowest thread, also while timing is off.
+ */
+double recordThreadTimes(const ThreadTimes* times, int threads) {
+    double assign = 0;
+    double accumulate = 0;
+    double slowest = 0;
+    long long distances = 0;
+    int t;
+
+    for (t = 0; t < threads; t++) {
+        assign = times[t].assign > assign ? times[t].assign : assign;
+        accumulate = times[t].accumulate > accumulate ? times[t].accumulate : accumulate;
+        slowest = times[t].assign + times[t].accumulate > slowest ? times[t].assign + times[t].accumulate : slowest;
+        distances += times[t].distances;
+    }
+    addPhaseSeconds(PHASE_ASSIGN, assign);
+    addPhaseSeconds(PHASE_ACCUMULATE, accumulate);
+    addDistances(distances);
+    return slowest;
+}
+
+/*
+ * open the slot of a new iteration, and go back to slot 0 after the last
+ */
+void nextIteration(void) {
+    if (!enabled) {
+        return;
+    }
+    if (slotNums == slotCapacity) {
+        slotCapacity *= 2;
+        slots = realloc(slots, sizeof(double) * slotCapacity * SLOT_VALUES);
+    }
+    current = slotNums++;
+    memset(slots + current * SLOT_VALUES, 0, sizeof(double) * SLOT_VALUES);
+}
+
+void endIterations(void) {
+    current = 0;
+}
+
+/*
+ * write "name": {min, max, mean, imbalance} of one value across processes,
+ * stride values apart in values
+ */
+static void writeStatistics(FILE* report, const char* name, const double* values, int numprocs, int stride,
+                            const char* separator) {
+    double min = values[0];
+    double max = values[0];
+    double sum = 0;
+    double mean;
+    int p;
+
+    for (p = 0; p < numprocs; p++) {
+        double value = values[(size_t)p * stride];
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+        sum += value;
+    }
+    mean = sum / numprocs;
+    fprintf(report, "\"%s\": {\"min\": %.9g, \"max\": %.9g, \"mean\": %.9g, \"imbalance\": %.6g}%s",
+            name, min, max, mean, mean > 0 ? max / mean : 1.0, separator);
+}
+
+/*
+ * collect the timings of all processes of comm and write the report on
+ * the master, does nothing unless timing was started
+ */
+void writeTimingReport(MPI_Comm comm, const char* filename) {
+    int rank, numprocs;
+    int slotMax;
+    int s, p, v;
+    double* padded;
+    double* all = NULL;
+    /* the sum over all slots of every process */
+    double* totals = NULL;
+    FILE* report;
+
+    if (!enabled || filename == NULL) {
+        return;
+    }
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &numprocs);
+
+    /* the processes run the iterations in lockstep, the padding is only a safeguard */
+    MPI_Allreduce(&slotNums, &slotMax, 1, MPI_INT, MPI_MAX, comm);
+    padded = calloc((size_t)slotMax * SLOT_VALUES, sizeof(double));
+    memcpy(padded, slots, sizeof(double) * slotNums * SLOT_VALUES);
+    if (rank == 0) {
+        all = malloc(sizeof(double) * numprocs * slotMax * SLOT_VALUES);
+    }
+    MPI_Gather(padded, slotMax * SLOT_VALUES, MPI_DOUBLE, all, slotMax * SLOT_VALUES, MPI_DOUBLE, 0, comm);
+    free(padded);
+    if (rank != 0) {
+        return;
+    }
+
+    report = fopen(filename, "w");
+    if (report == NULL) {
+        printf("Cannot create file %s\n", filename);
+        free(all);
+        return;
+    }
+    totals = calloc((size_t)numprocs * SLOT_VALUES, sizeof(double));
+    for (p = 0; p < numprocs; p++) {
+        for (s = 0; s < slotMax; s++) {
+            for (v = 0; v < SLOT_VALUES; v++) {
+                totals[p * SLOT_VALUES + v] += all[((size_t)p * slotMax + s) * SLOT_VALUES + v];
+            }
+        }
+    }
+
+    fprintf(report, "{\n \"processes\": %d,\n \"iterations\": %d,\n", numprocs, slotMax - 1);
+
+    /* the whole run of every process */
+    fprintf(report, " \"phases\": {\n");
+    for (v = 0; v < PHASE_COUNT; v++) {
+        fprintf(report, "  ");
+        writeStatistics(report, phaseNames[v], totals + v, numprocs, SLOT_VALUES, v + 1 < PHASE_COUNT ? ",\n" : "\n");
+    }
+    fprintf(report, " },\n  ");
+    writeStatistics(report, "distances", totals + PHASE_COUNT, numprocs, SLOT_VALUES, ",\n");
+
+    fprintf(report, " \"ranks\": [\n");
+    for (p = 0; p < numprocs; p++) {
+        fprintf(report, "  {\"rank\": %d", p);
+        for (v = 0; v < PHASE_COUNT; v++) {
+            fprintf(report, ", \"%s\": %.9g", phaseNames[v], totals[p * SLOT_VALUES + v]);
+        }
+        fprintf(report, ", \"distances\": %.0f}%s\n", totals[p * SLOT_VALUES + PHASE_COUNT], p + 1 < numprocs ? "," : "");
+    }
+    fprintf(report, " ],\n");
+
+    /* slot 0 is the work outside the iterations */
+    fprintf(report, " \"perIteration\": [\n");
+    for (s = 0; s < slotMax; s++) {
+        const double* slot = all + (size_t)s * SLOT_VALUES;
+        int stride = slotMax * SLOT_VALUES;
+        fprintf(report, "  {\"iteration\": %d,\n   ", s);
+        for (v = 0; v < PHASE_COUNT; v++) {
+            writeStatistics(report, phaseNames[v], slot + v, numprocs, stride, ",\n   ");
+        }
+        writeStatistics(report, "distances", slot + PHASE_COUNT, numprocs, stride, "");
+        fprintf(report, "}%s\n", s + 1 < slotMax ? "," : "");
+    }
+    fprintf(report, " ]\n}\n");
+
+    fclose(report);
+    free(totals);
+    free(all);
+}
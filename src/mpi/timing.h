@@ -0,0 +1,77 @@
+#ifndef _TIMING_H_
+#define _TIMING_H_
+
+#include "mpi.h"
+
+/*
+ * Per-phase timing of a run, enabled with --timing FILE. Every process
+ * adds the seconds of each phase to the current slot: slot 0 holds the
+ * work outside the iterations, every iteration gets a slot of its own.
+ * The distance computations are counted alongside. At the end the master
+ * collects the slots of all processes and writes a JSON report with the
+ * min, max and mean of each phase across processes and the imbalance
+ * factor max / mean. While timing is off every call returns at once.
+ */
+
+/* the phases of a run */
+#define PHASE_READ 0        /* loading the rows, or waiting for a streamed chunk */
+#define PHASE_SEED 1        /* picking the first centroids */
+#define PHASE_ASSIGN 2      /* the nearest centroid of every row */
+#define PHASE_ACCUMULATE 3  /* summing the rows of each cluster */
+#define PHASE_REDUCE 4      /* the collective over the sums */
+#define PHASE_UPDATE 5      /* the new centroids, the bounds and the index */
+#define PHASE_GATHER 6      /* collecting or writing the labels */
+#define PHASE_COUNT 7
+
+/*
+ * what one thread of the pool did in one pass
+ */
+typedef struct {
+    double assign;
+    double accumulate;
+    long long distances;
+} ThreadTimes;
+
+/*
+ * start recording on this process
+ */
+void startTiming(void);
+
+/*
+ * the current time in seconds, safe to call from any thread
+ */
+double timerNow(void);
+
+void beginPhase(int phase);
+void endPhase(int phase);
+
+/*
+ * add seconds measured elsewhere to a phase of the current slot
+ */
+void addPhaseSeconds(int phase, double seconds);
+
+/*
+ * add the distance computations of this process
+ */
+void addDistances(long long distances);
+
+/*
+ * the threads run side by side, so a pass takes as long as its slowest
+ * thread: adds the longest assign and accumulate times and all distances.
+ * Returns the time of the slowest thread, also while timing is off.
+ */
+double recordThreadTimes(const ThreadTimes* times, int threads);
+
+/*
+ * open the slot of a new iteration, and go back to slot 0 after the last
+ */
+void nextIteration(void);
+void endIterations(void);
+
+/*
+ * collect the timings of all processes of comm and write the report on
+ * the master, does nothing unless timing was started
+ */
+void writeTimingReport(MPI_Comm comm, const char* filename);
+
+#endif
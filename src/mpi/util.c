@@ -1,85 +1,295 @@
 #include "Util.h"
+#include "vecdist.h"
+
+/* the value of --prune auto until the number of clusters is known */
+#define PRUNE_AUTO -1
 
 /*
- * read 2D file
+ * the value of an integer option, which must not be below minimum
  */
-void read2DContents(FILE* file, double* array) {
-	int index = 0;
-	/* file not open */
-	if (file == NULL) {
-		printf("File not open\n");
-		exit(1);
-	}
-	
-	/* scan the whole file line by line */
-	while(fscanf(file,"%lf,%lf\n",array + 2 * index,array + 2 * index + 1) != EOF) {
-		index++;
-	}
-	
+static int integerOption(const char* name, const char* value, int minimum) {
+    char* end;
+    long number = strtol(value, &end, 10);
+    if (*end != '\0' || number < minimum || number > 2147483647) {
+        printf("Option %s needs an integer of at least %d, not %s\n", name, minimum, value);
+        exit(-1);
+    }
+    return (int)number;
 }
 
 /*
- * read DNA file
+ * the cluster numbers of --sweep: a comma separated list of numbers and FROM:TO ranges
  */
-void readDNAContents(FILE* file, char* array, int dimension) {
+static void sweepOption(const char* name, const char* value, KMeansOptions* options) {
+    const char* item = value;
+    int capacity = 16;
+
+    options->sweep = malloc(sizeof(int) * capacity);
+    options->sweepNums = 0;
+    while (1) {
+        char* end;
+        long from = strtol(item, &end, 10);
+        long to = from;
+        if (end != item && *end == ':') {
+            to = strtol(end + 1, &end, 10);
+        }
+        if (end == item || (*end != ',' && *end != '\0') || from < 1 || to < from || to > 1000000) {
+            printf("Option %s needs numbers of at least 1 or FROM:TO ranges, not %s\n", name, value);
+            exit(-1);
+        }
+        for (; from <= to; from++) {
+            if (options->sweepNums == capacity) {
+                capacity *= 2;
+                options->sweep = realloc(options->sweep, sizeof(int) * capacity);
+            }
+            options->sweep[options->sweepNums++] = (int)from;
+        }
+        if (*end == '\0') {
+            break;
+        }
+        item = end + 1;
+    }
+}
+
+/*
+ * take the options out of argv, returns the number of arguments left
+ */
+int parseOptions(int argc, char** argv, KMeansOptions* options) {
+    int i;
+    int left = 1;
     
-	if (file == NULL) {
-		printf ("File not open\n");
-		exit(1);
-	}
-	
-	int index = 1;
-	while (1) {
-		int result;
-		if(index % dimension == 0) {
-			result = fscanf(file,"%c\n", array + index - 1);
-		} else {
-			result = fscanf(file,"%c,", array + index - 1);
-		}
-		if (result == EOF)
-			break;
-		index++;
-	}
+    options->prune = PRUNE_NONE;
+    options->maxIterations = 0;
+    options->miniBatch = 0;
+    options->finalPass = 1;
+    options->init = INIT_KMEANSPARALLEL;
+    options->threads = 1;
+    options->index = INDEX_NONE;
+    options->stream = 0;
+    options->spill = "labels";
+    options->pipeline = 1;
+    options->timing = NULL;
+    options->labels = NULL;
+    options->labelsFormat = LABELS_TEXT;
+    options->centroids = NULL;
+    options->rebalance = 0;
+    options->delta = 0;
+    options->minChanged = 0;
+    options->ownedCentroids = 0;
+    options->restarts = 1;
+    options->sweep = NULL;
+    options->sweepNums = 0;
+    options->variableLength = 0;
+    options->band = 0;
+    options->precision = PRECISION_DOUBLE;
+    options->sharedMemory = 0;
+    
+    for (i = 1; i < argc; i++) {
+        char* name = argv[i];
+        char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        
+        /* the positional arguments stay in place */
+        if (strncmp(name, "--", 2) != 0) {
+            argv[left++] = name;
+            continue;
+        }
+        if (value == NULL) {
+            printf("Option %s needs a value\n", name);
+            exit(-1);
+        }
+        
+        if (strcmp(name, "--prune") == 0) {
+            if (strcmp(value, "none") == 0) {
+                options->prune = PRUNE_NONE;
+            } else if (strcmp(value, "hamerly") == 0) {
+                options->prune = PRUNE_HAMERLY;
+            } else if (strcmp(value, "elkan") == 0) {
+                options->prune = PRUNE_ELKAN;
+            } else if (strcmp(value, "auto") == 0) {
+                options->prune = PRUNE_AUTO;
+            } else {
+                printf("Unknown --prune %s, use none, hamerly, elkan or auto\n", value);
+                exit(-1);
+            }
+        } else if (strcmp(name, "--max-iterations") == 0) {
+            options->maxIterations = integerOption(name, value, 0);
+        } else if (strcmp(name, "--minibatch") == 0) {
+            options->miniBatch = integerOption(name, value, 0);
+        } else if (strcmp(name, "--final-pass") == 0) {
+            options->finalPass = integerOption(name, value, 0) != 0;
+        } else if (strcmp(name, "--index") == 0) {
+            if (strcmp(value, "none") == 0) {
+                options->index = INDEX_NONE;
+            } else if (strcmp(value, "kdtree") == 0) {
+                options->index = INDEX_KDTREE;
+            } else {
+                printf("Unknown --index %s, use none or kdtree\n", value);
+                exit(-1);
+            }
+        } else if (strcmp(name, "--stream") == 0) {
+            options->stream = integerOption(name, value, 0);
+        } else if (strcmp(name, "--spill") == 0) {
+            options->spill = value;
+        } else if (strcmp(name, "--pipeline") == 0) {
+            options->pipeline = integerOption(name, value, 1);
+        } else if (strcmp(name, "--timing") == 0) {
+            options->timing = value;
+        } else if (strcmp(name, "--labels") == 0) {
+            options->labels = value;
+        } else if (strcmp(name, "--labels-format") == 0) {
+            if (strcmp(value, "text") == 0) {
+                options->labelsFormat = LABELS_TEXT;
+            } else if (strcmp(value, "binary") == 0) {
+                options->labelsFormat = LABELS_BINARY;
+            } else {
+                printf("Unknown --labels-format %s, use text or binary\n", value);
+                exit(-1);
+            }
+        } else if (strcmp(name, "--centroids") == 0) {
+            options->centroids = value;
+        } else if (strcmp(name, "--rebalance") == 0) {
+            options->rebalance = integerOption(name, value, 0);
+        } else if (strcmp(name, "--delta") == 0) {
+            options->delta = integerOption(name, value, 0) != 0;
+        } else if (strcmp(name, "--min-changed") == 0) {
+            options->minChanged = integerOption(name, value, 0);
+        } else if (strcmp(name, "--owned-centroids") == 0) {
+            options->ownedCentroids = integerOption(name, value, 0) != 0;
+        } else if (strcmp(name, "--restarts") == 0) {
+            options->restarts = integerOption(name, value, 1);
+        } else if (strcmp(name, "--sweep") == 0) {
+            sweepOption(name, value, options);
+        } else if (strcmp(name, "--variable-length") == 0) {
+            options->variableLength = integerOption(name, value, 0) != 0;
+        } else if (strcmp(name, "--band") == 0) {
+            options->band = integerOption(name, value, 0);
+        } else if (strcmp(name, "--precision") == 0) {
+            if (strcmp(value, "double") == 0) {
+                options->precision = PRECISION_DOUBLE;
+            } else if (strcmp(value, "single") == 0) {
+                options->precision = PRECISION_SINGLE;
+            } else {
+                printf("Unknown --precision %s, use double or single\n", value);
+                exit(-1);
+            }
+        } else if (strcmp(name, "--shared-memory") == 0) {
+            options->sharedMemory = integerOption(name, value, 0) != 0;
+        } else if (strcmp(name, "--threads") == 0) {
+            options->threads = integerOption(name, value, 1);
+        } else if (strcmp(name, "--init") == 0) {
+            if (strcmp(value, "random") == 0) {
+                options->init = INIT_RANDOM;
+            } else if (strcmp(value, "kmeans++") == 0) {
+                options->init = INIT_KMEANSPP;
+            } else if (strcmp(value, "kmeans||") == 0) {
+                options->init = INIT_KMEANSPARALLEL;
+            } else {
+                printf("Unknown --init %s, use random, kmeans++ or kmeans||\n", value);
+                exit(-1);
+            }
+        } else {
+            printf("Unknown option %s\n", name);
+            exit(-1);
+        }
+        i++;
+    }
+    argv[left] = NULL;
+    return left;
 }
 
+/*
+ * resolve the settings that depend on each other or on the number of clusters
+ */
+void resolveOptions(KMeansOptions* options, int cluster) {
+    if (options->prune == PRUNE_AUTO) {
+        options->prune = cluster < PRUNE_ELKAN_MIN_CLUSTER ? PRUNE_HAMERLY : PRUNE_ELKAN;
+    }
+    /* the mini-batches rarely reach the threshold, so they always have a limit */
+    if (options->miniBatch > 0 && options->maxIterations == 0) {
+        options->maxIterations = MINIBATCH_MAX_ITERATIONS;
+    }
+}
 
 /*
  * generate 2D centroids
  */
-void generate2DCentroids(double* centroids, double* source, int lineNums, int dimension, int cluster) {
-	int i;
+int generate2DCentroids(double* centroids, double* source, int lineNums, int dimension, int cluster) {
+	int i, tries;
     /* select the random line */
 	int index = ((int)rand()) % lineNums;
     /* copy the select line into the centroids array */
 	memcpy(centroids, source + index * dimension,dimension * sizeof(double));
 	for (i = 0;i < cluster;i++) {
 		/* if the selected point is too close with any selected centroids,
-         * it will reselect the point */
-        while(tooClose(centroids, source + index * dimension, i)) {
+         * it will reselect the point, up to RANDOM_SEED_RETRIES times */
+        for (tries = 0; tooClose(centroids, source + index * dimension, dimension, i); tries++) {
+            if (tries == RANDOM_SEED_RETRIES) {
+                return 0;
+            }
 			index = ((int)rand())%lineNums;
 		}
 		memcpy(centroids + i*dimension, source+index*dimension,dimension * sizeof(double));
 	}
+	return 1;
 }
 
 /*
  * generate DNA centroids
  */
-void generateDNACentroids(char* centroids, char* source, int lineNums, int dimension, int cluster) {
-	int i;
+int generateDNACentroids(char* centroids, char* source, int lineNums, int dimension, int cluster) {
+	int i, tries;
     /* select the random line */
 	int index = ((int)rand())%lineNums;
     /* copy the select line into the centroids array */
 	memcpy(centroids,source+index*dimension,dimension);
 	index = ((int)rand() )% lineNums;
 	for (i = 1;i < cluster;i++) {
-		while(tooSimilar(centroids, source+index*dimension, dimension, i)) {
+		for (tries = 0; tooSimilar(centroids, source+index*dimension, dimension, i); tries++) {
+            if (tries == RANDOM_SEED_RETRIES) {
+                return 0;
+            }
 			index = ((int)rand())%lineNums;
 		}
 		memcpy(centroids+i*dimension, source+index*dimension, dimension);
 	}
+	return 1;
+}
+
+/*
+ * the rows of one process: every process gets lineNums / numprocs rows
+ * and the first lineNums % numprocs processes one more
+ */
+void partitionRows(int lineNums, int numprocs, int rank, int* firstRow, int* rows) {
+    /* for example: 501 lines and 10 processor
+     * the first processor gets 51 lines and the others 50,
+     * so no processor has more than one line more than another.
+     */
+    int handleNumbers = lineNums / numprocs;
+    int remainder = lineNums % numprocs;
+    
+    *firstRow = rank * handleNumbers + (rank < remainder ? rank : remainder);
+    *rows = handleNumbers + (rank < remainder ? 1 : 0);
 }
 
+/*
+ * choose the global row indices the master seeds the centroids from.
+ * Small inputs offer every row, larger ones a random sample of
+ * SEED_CANDIDATE_FACTOR rows per cluster.
+ */
+int* seedCandidates(int lineNums, int cluster, int* candidateNums) {
+    int i;
+    int* candidates;
+    
+    *candidateNums = cluster * SEED_CANDIDATE_FACTOR;
+    if (*candidateNums >= lineNums) {
+        *candidateNums = lineNums;
+    }
+    candidates = malloc(sizeof(int) * *candidateNums);
+    for (i = 0; i < *candidateNums; i++) {
+        candidates[i] = *candidateNums == lineNums ? i : ((int)rand()) % lineNums;
+    }
+    return candidates;
+}
 
 /*
  * 2D : compute the distance
@@ -105,11 +315,11 @@ int DNADistance(char* centroid, char* strand, int dimension) {
 /*
  * determin whether the source point are too close to one of the centroids
  */
-int tooClose(double* centroids, double* source, int num) {
+int tooClose(double* centroids, double* source, int dimension, int num) {
 	double minDist = 0.5;
 	int i;
 	for(i = 0;i<num;i++){
-		if(TwoDDistance(centroids+i*2, source) < minDist)
+		if(squaredDistance(centroids+i*dimension, source, dimension) < minDist * minDist)
 			return 1;
 	}
 	return 0;
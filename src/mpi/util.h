@@ -6,24 +6,135 @@
 #include "math.h"
 #include "string.h"
 
+/* the number of candidate rows per cluster offered to the seeding */
+#define SEED_CANDIDATE_FACTOR 64
+/* the rows --init random draws per cluster before it gives up finding one far enough from the others */
+#define RANDOM_SEED_RETRIES 1000
+
+/* the ways the assignment step can skip distance computations */
+#define PRUNE_NONE 0
+#define PRUNE_HAMERLY 1
+#define PRUNE_ELKAN 2
+/* --prune auto picks Hamerly below this many clusters and Elkan from it on */
+#define PRUNE_ELKAN_MIN_CLUSTER 32
+
+/* the ways the centroids are seeded, see seeding.h */
+#define INIT_RANDOM 0
+#define INIT_KMEANSPP 1
+#define INIT_KMEANSPARALLEL 2
+
+/* the ways the full assignment finds the nearest centroid */
+#define INDEX_NONE 0
+#define INDEX_KDTREE 1
+
+/* the formats of the label file */
+#define LABELS_TEXT 0
+#define LABELS_BINARY 1
+
+/* the precision the points are stored and compared in */
+#define PRECISION_DOUBLE 0
+#define PRECISION_SINGLE 1
+
+/* the iteration limit of the mini-batch mode when --max-iterations is not given */
+#define MINIBATCH_MAX_ITERATIONS 100
+
 /*
- * read 2D file
+ * the optional settings, given as "--name value" after the positional arguments
  */
-void read2DContents(FILE* file, double* array);
+typedef struct {
+    /* --prune none|hamerly|elkan|auto : bound based assignment */
+    int prune;
+    /* --max-iterations N : stop after N iterations, 0 runs until convergence */
+    int maxIterations;
+    /* --minibatch B : rows sampled per process and iteration, 0 uses every row */
+    int miniBatch;
+    /* --final-pass 0|1 : assign every row once the mini-batches are done */
+    int finalPass;
+    /* --init random|kmeans++|kmeans|| : how the centroids are seeded */
+    int init;
+    /* --threads T : threads sharing the rows of each process */
+    int threads;
+    /* --index none|kdtree : points only, centroid index of the full assignment, unused when pruning */
+    int index;
+    /* --stream CHUNK : read the rows of a binary file CHUNK at a time on every iteration, 0 loads them */
+    int stream;
+    /* --spill PREFIX : the labels of a streamed run go to PREFIX.<rank> */
+    const char* spill;
+    /* --pipeline BLOCKS : reduce the sums of each block of rows while the next one is assigned */
+    int pipeline;
+    /* --timing FILE : write the time of every phase on every process to FILE as JSON */
+    const char* timing;
+    /* --labels FILE : every process writes the labels of its rows into FILE instead of gathering them */
+    const char* labels;
+    /* --labels-format text|binary : one label per line or native ints */
+    int labelsFormat;
+    /* --centroids FILE : the master writes the final centroids to FILE */
+    const char* centroids;
+    /* --rebalance N : after N iterations move rows between processes by their speed, see rebalance.h,
+     * not with --stream or --minibatch */
+    int rebalance;
+    /* --delta 0|1 : only sum the rows that changed cluster into kept sums, not with --stream or --minibatch */
+    int delta;
+    /* --min-changed ROWS : with --delta also stop once at most ROWS rows changed cluster in an iteration */
+    int minChanged;
+    /* --owned-centroids 0|1 : DNA only, every process reduces and updates a slice of the clusters
+     * with MPI_Reduce_scatter and MPI_Allgatherv, ignored with --stream and --minibatch */
+    int ownedCentroids;
+    /* --restarts R : split the processes into R groups that each seed and run k-means on all the rows,
+     * the result with the lowest cost is kept, see restarts.h, not with --stream or --final-pass 0 */
+    int restarts;
+    /* --sweep LIST : run every k of LIST, e.g. 2:16 or 4,8,16, instead of the cluster number and
+     * report the cost of each, see the drivers, not with --stream, --restarts or --final-pass 0 */
+    int* sweep;
+    int sweepNums;
+    /* --variable-length 0|1 : DNA text files whose strands differ in length, clustered by edit
+     * distance around medoids, see editkmeans.h, only with --threads, --max-iterations, --band and the
+     * outputs, not with --stream, --restarts, --sweep or any other mode of the fixed length engine */
+    int variableLength;
+    /* --band W : with --variable-length only compute edit distances up to W, 0 computes all */
+    int band;
+    /* --precision double|single : points only, store the rows and compare them with the centroids
+     * in float while the sums and the centroids stay double, see vectorKMeansSingle, not with
+     * --stream, --sweep, --prune, --index, --pipeline, --delta, --rebalance or --minibatch */
+    int precision;
+    /* --shared-memory 0|1 : binary data sets only, the processes of a node keep their rows in one
+     * window of MPI_Win_allocate_shared read in by the first of them, see readSharedPartition, not
+     * with --stream, --restarts, --rebalance or --precision single, which replace the rows */
+    int sharedMemory;
+} KMeansOptions;
+
+/*
+ * take the options out of argv, returns the number of arguments left
+ */
+int parseOptions(int argc, char** argv, KMeansOptions* options);
+
+/*
+ * resolve the settings that depend on each other or on the number of clusters
+ */
+void resolveOptions(KMeansOptions* options, int cluster);
+
+/*
+ * generate 2D centroids, returns 0 if no row far enough from the
+ * centroids so far was drawn within RANDOM_SEED_RETRIES tries
+ */
+int generate2DCentroids(double* centroids, double* source, int lineNums, int dimension, int cluster);
+
 /*
- * read DNA file
+ * generate DNA centroids, returns 0 if no strand different enough from the
+ * centroids so far was drawn within RANDOM_SEED_RETRIES tries
  */
-void readDNAContents(FILE* file, char* array, int dimension);
+int generateDNACentroids(char* centroids, char* source, int lineNums, int dimension, int cluster);
 
 /*
- * generate 2D centroids
+ * the rows of one process: every process gets lineNums / numprocs rows
+ * and the first lineNums % numprocs processes one more
  */
-void generate2DCentroids(double* centroids, double* source, int lineNums, int dimension, int cluster);
+void partitionRows(int lineNums, int numprocs, int rank, int* firstRow, int* rows);
 
 /*
- * generate DNA centroids
+ * choose the global row indices the master seeds the centroids from
  */
-void generateDNACentroids(char* centroids, char* source, int lineNums, int dimension, int cluster);
+int* seedCandidates(int lineNums, int cluster, int* candidateNums);
 
 /*
  * 2D : compute the distance
@@ -38,7 +149,7 @@ int DNADistance(char* centroid, char* strand, int dimension);
 /*
  * determin whether the source point are too close to one of the centroids
  */
-int tooClose(double* centroids, double* source, int num);
+int tooClose(double* centroids, double* source, int dimension, int num);
 
 /*
  * determin whether the source strand are too similar to one of the centroids
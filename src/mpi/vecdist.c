@@ -0,0 +1,357 @@
+#include <stddef.h>
+#include <float.h>
+#include "vecdist.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VECDIST_X86 1
+#include <immintrin.h>
+#endif
+
+/* the signature shared by every nearest centroid kernel */
+typedef int (*NearestKernel)(const double* point, const double* centroids, int cluster, int dimension, double* distance);
+
+/* and by the single precision ones over transposed centroids */
+typedef int (*NearestSingleKernel)(const float* point, const float* centroids, int cluster, int dimension);
+
+/*
+ * the plain loop, the compiler unrolls it when dimension is a constant
+ */
+static inline double squaredDistanceLoop(const double* a, const double* b, int dimension) {
+    int i;
+    double sum = 0;
+    for (i = 0; i < dimension; i++) {
+        double diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+/*
+ * the argmin over the centroids for a fixed dimension
+ */
+#define NEAREST_FIXED(D)                                                                          \
+static int nearest##D(const double* point, const double* centroids, int cluster, int dimension, double* distance) { \
+    int j;                                                                                        \
+    int category = -1;                                                                            \
+    double minDistance = DBL_MAX;                                                                 \
+    (void)dimension;                                                                              \
+    for (j = 0; j < cluster; j++) {                                                               \
+        double calculatedDistance = squaredDistanceLoop(point, centroids + (size_t)j * D, D);     \
+        if (calculatedDistance < minDistance) {                                                   \
+            minDistance = calculatedDistance;                                                     \
+            category = j;                                                                         \
+        }                                                                                         \
+    }                                                                                             \
+    *distance = minDistance;                                                                      \
+    return category;                                                                              \
+}
+
+NEAREST_FIXED(2)
+NEAREST_FIXED(3)
+NEAREST_FIXED(4)
+
+/*
+ * the argmin over the centroids for any dimension
+ */
+static int nearestScalar(const double* point, const double* centroids, int cluster, int dimension, double* distance) {
+    int j;
+    int category = -1;
+    double minDistance = DBL_MAX;
+    for (j = 0; j < cluster; j++) {
+        double calculatedDistance = squaredDistanceLoop(point, centroids + (size_t)j * dimension, dimension);
+        if (calculatedDistance < minDistance) {
+            minDistance = calculatedDistance;
+            category = j;
+        }
+    }
+    *distance = minDistance;
+    return category;
+}
+
+/*
+ * the argmin over transposed float centroids, one centroid at a time
+ */
+static int nearestSingleScalar(const float* point, const float* centroids, int cluster, int dimension) {
+    int j, d;
+    int category = -1;
+    float minDistance = FLT_MAX;
+    for (j = 0; j < cluster; j++) {
+        float calculatedDistance = 0;
+        for (d = 0; d < dimension; d++) {
+            float diff = point[d] - centroids[(size_t)d * cluster + j];
+            calculatedDistance += diff * diff;
+        }
+        if (calculatedDistance < minDistance) {
+            minDistance = calculatedDistance;
+            category = j;
+        }
+    }
+    return category;
+}
+
+#ifdef VECDIST_X86
+
+/*
+ * the nearest of the lanes of the vector kernels, the lowest index among
+ * equally near ones as in the scalar loop
+ */
+static int nearestLane(const float* distances, const int* indices, int lanes, float* minDistance) {
+    int lane;
+    int category = -1;
+    *minDistance = FLT_MAX;
+    for (lane = 0; lane < lanes; lane++) {
+        if (indices[lane] >= 0 && (distances[lane] < *minDistance ||
+                                   (distances[lane] == *minDistance && indices[lane] < category))) {
+            *minDistance = distances[lane];
+            category = indices[lane];
+        }
+    }
+    return category;
+}
+
+/*
+ * AVX2 single precision : 8 centroids per FMA, one broadcast coordinate
+ * of the point against the same coordinate of each, the centroids past
+ * the last full 8 are finished in scalar
+ */
+__attribute__((target("avx2,fma")))
+static int nearestSingleAVX2(const float* point, const float* centroids, int cluster, int dimension) {
+    __m256 best = _mm256_set1_ps(FLT_MAX);
+    __m256i bestIndex = _mm256_set1_epi32(-1);
+    __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    float distances[8];
+    int indices[8];
+    float minDistance;
+    int category;
+    int j = 0;
+    int d;
+
+    for (; j + 8 <= cluster; j += 8) {
+        __m256 sum = _mm256_setzero_ps();
+        __m256 closer;
+        for (d = 0; d < dimension; d++) {
+            __m256 diff = _mm256_sub_ps(_mm256_set1_ps(point[d]), _mm256_loadu_ps(centroids + (size_t)d * cluster + j));
+            sum = _mm256_fmadd_ps(diff, diff, sum);
+        }
+        closer = _mm256_cmp_ps(sum, best, _CMP_LT_OQ);
+        best = _mm256_blendv_ps(best, sum, closer);
+        bestIndex = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestIndex),
+                                                         _mm256_castsi256_ps(index), closer));
+        index = _mm256_add_epi32(index, _mm256_set1_epi32(8));
+    }
+    _mm256_storeu_ps(distances, best);
+    _mm256_storeu_si256((__m256i*)indices, bestIndex);
+    category = nearestLane(distances, indices, 8, &minDistance);
+
+    for (; j < cluster; j++) {
+        float calculatedDistance = 0;
+        for (d = 0; d < dimension; d++) {
+            float diff = point[d] - centroids[(size_t)d * cluster + j];
+            calculatedDistance += diff * diff;
+        }
+        if (calculatedDistance < minDistance) {
+            minDistance = calculatedDistance;
+            category = j;
+        }
+    }
+    return category;
+}
+
+/*
+ * AVX-512 single precision : 16 centroids per FMA, the last ones loaded with a mask
+ */
+__attribute__((target("avx512f")))
+static int nearestSingleAVX512(const float* point, const float* centroids, int cluster, int dimension) {
+    __m512 best = _mm512_set1_ps(FLT_MAX);
+    __m512i bestIndex = _mm512_set1_epi32(-1);
+    __m512i index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    float distances[16];
+    int indices[16];
+    float minDistance;
+    int j, d;
+
+    for (j = 0; j < cluster; j += 16) {
+        __mmask16 mask = cluster - j >= 16 ? 0xffff : (__mmask16)((1u << (cluster - j)) - 1);
+        __m512 sum = _mm512_setzero_ps();
+        __mmask16 closer;
+        for (d = 0; d < dimension; d++) {
+            __m512 diff = _mm512_sub_ps(_mm512_set1_ps(point[d]),
+                                        _mm512_maskz_loadu_ps(mask, centroids + (size_t)d * cluster + j));
+            sum = _mm512_fmadd_ps(diff, diff, sum);
+        }
+        closer = _mm512_mask_cmp_ps_mask(mask, sum, best, _CMP_LT_OQ);
+        best = _mm512_mask_mov_ps(best, closer, sum);
+        bestIndex = _mm512_mask_mov_epi32(bestIndex, closer, index);
+        index = _mm512_add_epi32(index, _mm512_set1_epi32(16));
+    }
+    _mm512_storeu_ps(distances, best);
+    _mm512_storeu_si512(indices, bestIndex);
+    return nearestLane(distances, indices, 16, &minDistance);
+}
+
+/*
+ * AVX2 : two independent 4-wide FMA chains, the tail is finished in scalar
+ */
+__attribute__((target("avx2,fma")))
+static inline double squaredDistanceAVX2(const double* a, const double* b, int dimension) {
+    __m256d first = _mm256_setzero_pd();
+    __m256d second = _mm256_setzero_pd();
+    __m128d half;
+    double sum;
+    int i = 0;
+
+    for (; i + 8 <= dimension; i += 8) {
+        __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+        __m256d next = _mm256_sub_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4));
+        first = _mm256_fmadd_pd(diff, diff, first);
+        second = _mm256_fmadd_pd(next, next, second);
+    }
+    for (; i + 4 <= dimension; i += 4) {
+        __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+        first = _mm256_fmadd_pd(diff, diff, first);
+    }
+    first = _mm256_add_pd(first, second);
+    half = _mm_add_pd(_mm256_castpd256_pd128(first), _mm256_extractf128_pd(first, 1));
+    sum = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    for (; i < dimension; i++) {
+        double diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static int nearestAVX2(const double* point, const double* centroids, int cluster, int dimension, double* distance) {
+    int j;
+    int category = -1;
+    double minDistance = DBL_MAX;
+    for (j = 0; j < cluster; j++) {
+        double calculatedDistance = squaredDistanceAVX2(point, centroids + (size_t)j * dimension, dimension);
+        if (calculatedDistance < minDistance) {
+            minDistance = calculatedDistance;
+            category = j;
+        }
+    }
+    *distance = minDistance;
+    return category;
+}
+
+/*
+ * AVX-512 : 8-wide FMA, the tail is loaded with a mask
+ */
+__attribute__((target("avx512f")))
+static inline double squaredDistanceAVX512(const double* a, const double* b, int dimension) {
+    __m512d sum = _mm512_setzero_pd();
+    int i;
+    for (i = 0; i < dimension; i += 8) {
+        __mmask8 mask = dimension - i >= 8 ? 0xff : (__mmask8)((1u << (dimension - i)) - 1);
+        __m512d diff = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, a + i), _mm512_maskz_loadu_pd(mask, b + i));
+        sum = _mm512_fmadd_pd(diff, diff, sum);
+    }
+    return _mm512_reduce_add_pd(sum);
+}
+
+__attribute__((target("avx512f")))
+static int nearestAVX512(const double* point, const double* centroids, int cluster, int dimension, double* distance) {
+    int j;
+    int category = -1;
+    double minDistance = DBL_MAX;
+    for (j = 0; j < cluster; j++) {
+        double calculatedDistance = squaredDistanceAVX512(point, centroids + (size_t)j * dimension, dimension);
+        if (calculatedDistance < minDistance) {
+            minDistance = calculatedDistance;
+            category = j;
+        }
+    }
+    *distance = minDistance;
+    return category;
+}
+
+#endif
+
+/* the kernels chosen for this CPU, selected on first use */
+static NearestKernel wideKernel = NULL;
+static NearestSingleKernel singleKernel = NULL;
+
+/*
+ * choose the widest kernel the CPU supports
+ */
+static NearestKernel selectWideKernel(void) {
+#ifdef VECDIST_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return nearestAVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return nearestAVX2;
+    }
+#endif
+    return nearestScalar;
+}
+
+static NearestSingleKernel selectSingleKernel(void) {
+#ifdef VECDIST_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return nearestSingleAVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return nearestSingleAVX2;
+    }
+#endif
+    return nearestSingleScalar;
+}
+
+/*
+ * the squared distance between two vectors
+ */
+double squaredDistance(const double* a, const double* b, int dimension) {
+    return squaredDistanceLoop(a, b, dimension);
+}
+
+/*
+ * the index of the nearest centroid, its squared distance is stored in distance
+ */
+int nearestCentroid(const double* point, const double* centroids, int cluster, int dimension, double* distance) {
+    double ignored;
+    if (distance == NULL) {
+        distance = &ignored;
+    }
+    switch (dimension) {
+        case 2:
+            return nearest2(point, centroids, cluster, dimension, distance);
+        case 3:
+            return nearest3(point, centroids, cluster, dimension, distance);
+        case 4:
+            return nearest4(point, centroids, cluster, dimension, distance);
+        default:
+            if (wideKernel == NULL) {
+                wideKernel = selectWideKernel();
+            }
+            return wideKernel(point, centroids, cluster, dimension, distance);
+    }
+}
+
+/*
+ * the squared distance between two float vectors, summed in double
+ */
+double squaredDistanceSingle(const float* a, const float* b, int dimension) {
+    int i;
+    double sum = 0;
+    for (i = 0; i < dimension; i++) {
+        double diff = (double)a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+/*
+ * the index of the nearest of the cluster centroids stored transposed in
+ * centroids, the lowest one among equally near centroids
+ */
+int nearestCentroidSingle(const float* point, const float* centroids, int cluster, int dimension) {
+    if (singleKernel == NULL) {
+        singleKernel = selectSingleKernel();
+    }
+    return singleKernel(point, centroids, cluster, dimension);
+}
@@ -0,0 +1,37 @@
+#ifndef _VECDIST_H_
+#define _VECDIST_H_
+
+/*
+ * Squared Euclidean distances between dense double vectors. The argmin
+ * only needs the order of the distances, so no square root is taken.
+ * Dimensions 2, 3 and 4 have unrolled fast paths, the others use AVX2 or
+ * AVX-512 kernels chosen at runtime with a scalar fallback.
+ *
+ * The single precision kernels take the centroids transposed, dimension
+ * rows of cluster floats, and compare one point with 8 (AVX2) or 16
+ * (AVX-512) centroids at once, which suits the low dimensions the
+ * double kernels can only unroll.
+ */
+
+/*
+ * the squared distance between two vectors
+ */
+double squaredDistance(const double* a, const double* b, int dimension);
+
+/*
+ * the index of the nearest centroid, its squared distance is stored in distance
+ */
+int nearestCentroid(const double* point, const double* centroids, int cluster, int dimension, double* distance);
+
+/*
+ * the squared distance between two float vectors, summed in double
+ */
+double squaredDistanceSingle(const float* a, const float* b, int dimension);
+
+/*
+ * the index of the nearest of the cluster centroids stored transposed in
+ * centroids, the lowest one among equally near centroids
+ */
+int nearestCentroidSingle(const float* point, const float* centroids, int cluster, int dimension);
+
+#endif
@@ -0,0 +1,798 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vectorkmeans.h"
+#include "vecdist.h"
+#include "bounds.h"
+#include "threadpool.h"
+#include "centroidindex.h"
+#include "timing.h"
+#include "rebalance.h"
+
+/*
+ * mini-batch k-means: every process samples options->miniBatch of its rows
+ * per iteration, and each centroid moves towards the mean of its batch
+ * members with a learning rate of one over the number of points it has
+ * seen so far. Returns the number of iterations.
+ */
+static int vectorMiniBatch(MPI_Comm comm, const double* rows, int localRows, int dimension, int cluster,
+                           const KMeansOptions* options, double* centroids, int* categories) {
+    int i, j;
+    int rank;
+    int iterations = 0;
+    unsigned int seed;
+
+    /* the batch sums of every cluster followed by the batch counts, reduced together */
+    int payload = cluster * (dimension + 1);
+    double* batchCentroids = malloc(sizeof(double) * payload);
+    double* distributedCentroids = malloc(sizeof(double) * payload);
+    double* distributedPoints = distributedCentroids + cluster * dimension;
+    /* the number of points each centroid has absorbed so far */
+    double* seenPoints = calloc(cluster, sizeof(double));
+
+    MPI_Comm_rank(comm, &rank);
+    seed = 1 + rank;
+
+    for (i = 0; i < localRows; i++) {
+        categories[i] = -1;
+    }
+
+    do {
+        double sumDistance = 0;
+
+        memset(batchCentroids, 0, sizeof(double) * payload);
+        iterations++;
+        nextIteration();
+
+        /* assign and sum a random batch of the local rows */
+        beginPhase(PHASE_ASSIGN);
+        for (i = 0; localRows > 0 && i < options->miniBatch; i++) {
+            int row = rand_r(&seed) % localRows;
+            const double* point = rows + (size_t)row * dimension;
+            int category = nearestCentroid(point, centroids, cluster, dimension, NULL);
+            categories[row] = category;
+            batchCentroids[cluster * dimension + category]++;
+            for (j = 0; j < dimension; j++) {
+                batchCentroids[category * dimension + j] += point[j];
+            }
+        }
+        endPhase(PHASE_ASSIGN);
+        addDistances(localRows > 0 ? (long long)options->miniBatch * cluster : 0);
+
+        beginPhase(PHASE_REDUCE);
+        MPI_Allreduce(batchCentroids, distributedCentroids, payload, MPI_DOUBLE, MPI_SUM, comm);
+        endPhase(PHASE_REDUCE);
+
+        /* c += (sum - n * c) / seen, the per-center learning rate n / seen applied to the batch mean */
+        beginPhase(PHASE_UPDATE);
+        for (i = 0; i < cluster; i++) {
+            double moved = 0;
+            if (distributedPoints[i] == 0) {
+                continue;
+            }
+            seenPoints[i] += distributedPoints[i];
+            for (j = 0; j < dimension; j++) {
+                double step = (distributedCentroids[i * dimension + j] - distributedPoints[i] * centroids[i * dimension + j]) / seenPoints[i];
+                centroids[i * dimension + j] += step;
+                moved += step * step;
+            }
+            sumDistance += sqrt(moved);
+        }
+        endPhase(PHASE_UPDATE);
+
+        if (sumDistance < TwoD_DIFF_THRESHOLD) {
+            break;
+        }
+    } while (iterations < options->maxIterations);
+    endIterations();
+
+    /* one full assignment so that every row has a category */
+    if (options->finalPass) {
+        beginPhase(PHASE_ASSIGN);
+        for (i = 0; i < localRows; i++) {
+            categories[i] = nearestCentroid(rows + (size_t)i * dimension, centroids, cluster, dimension, NULL);
+        }
+        endPhase(PHASE_ASSIGN);
+        addDistances((long long)localRows * cluster);
+    }
+
+    free(batchCentroids);
+    free(distributedCentroids);
+    free(seenPoints);
+    return iterations;
+}
+
+/*
+ * the state one Lloyd iteration shares between the threads of a process
+ */
+typedef struct {
+    const double* rows;
+    int localRows;
+    int dimension;
+    int cluster;
+    int prune;
+    /* the first iteration sets the bounds, the later ones first loosen them by drift */
+    int first;
+    const double* centroids;
+    /* the kd-tree over centroids, NULL for the linear scan */
+    const CentroidIndex* index;
+    const double* drift;
+    const double* halfDistances;
+    const double* separation;
+    int* categories;
+    double* upper;
+    double* lower;
+    /* one block of centroid sums followed by point counts per thread, stride doubles apart */
+    double* accumulators;
+    int stride;
+    /* what every thread did in the last pass */
+    ThreadTimes* times;
+    /* with --delta the category each row was last summed under, -1 for none, NULL without */
+    int* previous;
+} VectorStep;
+
+/*
+ * assign the rows of one thread and add them to its own accumulators
+ */
+static void vectorStep(void* arg, int thread, int threads) {
+    VectorStep* step = arg;
+    int dimension = step->dimension;
+    double* sums = step->accumulators + (size_t)thread * step->stride;
+    double* points = sums + step->cluster * dimension;
+    ThreadTimes* times = step->times + thread;
+    double start = timerNow();
+    double assigned;
+    int begin, end;
+    int i, j;
+
+    threadRows(step->localRows, thread, threads, &begin, &end);
+
+    /* Calculate the category of every point */
+    times->distances = 0;
+    if (step->index != NULL) {
+        for (i = begin; i < end; i++) {
+            step->categories[i] = nearestIndexedCentroid(step->index, step->rows + (size_t)i * dimension, NULL,
+                                                         &times->distances);
+        }
+    } else if (step->prune == PRUNE_NONE) {
+        for (i = begin; i < end; i++) {
+            step->categories[i] = nearestCentroid(step->rows + (size_t)i * dimension, step->centroids,
+                                                  step->cluster, dimension, NULL);
+        }
+        times->distances = (long long)(end - begin) * step->cluster;
+    } else if (step->first) {
+        times->distances = initVectorBounds(step->prune, step->rows, begin, end, dimension, step->centroids,
+                                            step->cluster, step->categories, step->upper, step->lower);
+    } else {
+        /* the bounds follow the centroids */
+        shiftVectorBounds(step->prune, begin, end, step->cluster, step->drift, step->categories,
+                          step->upper, step->lower);
+        times->distances = boundedVectorAssign(step->prune, step->rows, begin, end, dimension, step->centroids,
+                                               step->cluster, step->halfDistances, step->separation,
+                                               step->categories, step->upper, step->lower);
+    }
+    assigned = timerNow();
+    times->assign = assigned - start;
+
+    /* Calculate the new Centroids' sum */
+    memset(sums, 0, sizeof(double) * step->stride);
+    if (step->previous != NULL) {
+        /* only the rows that changed cluster move their point from one sum to the other,
+         * and the number of them follows the point counts */
+        for (i = begin; i < end; i++) {
+            const double* point = step->rows + (size_t)i * dimension;
+            int category = step->categories[i];
+            int before = step->previous[i];
+            if (category == before) {
+                continue;
+            }
+            points[category]++;
+            for (j = 0; j < dimension; j++) {
+                sums[category * dimension + j] += point[j];
+            }
+            if (before >= 0) {
+                points[before]--;
+                for (j = 0; j < dimension; j++) {
+                    sums[before * dimension + j] -= point[j];
+                }
+            }
+            points[step->cluster]++;
+            step->previous[i] = category;
+        }
+    } else {
+        for (i = begin; i < end; i++) {
+            const double* point = step->rows + (size_t)i * dimension;
+            int category = step->categories[i];
+            points[category]++;
+            /* sum each point */
+            for (j = 0; j < dimension; j++) {
+                sums[category * dimension + j] += point[j];
+            }
+        }
+    }
+    times->accumulate = timerNow() - assigned;
+}
+
+/*
+ * one assignment pass in blocks of rows: the sums of each block go out
+ * with MPI_Iallreduce while the threads assign the next block, and the
+ * reduced blocks are added up into distributedCentroids at the end.
+ * Returns how long the threads took over all blocks.
+ */
+static double pipelinedVectorPass(MPI_Comm comm, ThreadPool* pool, const VectorStep* step, int blocks, int lowerPerRow,
+                                int payload, double* blockSums, double* blockResults, MPI_Request* requests,
+                                double* distributedCentroids) {
+    int threads = poolThreads(pool);
+    double busy = 0;
+    int b, t, i;
+    int done;
+
+    for (b = 0; b < blocks; b++) {
+        VectorStep block = *step;
+        double* sums = blockSums + (size_t)b * payload;
+        int begin, end;
+
+        threadRows(step->localRows, b, blocks, &begin, &end);
+        block.rows = step->rows + (size_t)begin * step->dimension;
+        block.localRows = end - begin;
+        block.categories = step->categories + begin;
+        if (step->previous != NULL) {
+            block.previous = step->previous + begin;
+        }
+        if (step->upper != NULL) {
+            block.upper = step->upper + begin;
+            block.lower = step->lower + (size_t)begin * lowerPerRow;
+        }
+        runThreadPool(pool, vectorStep, &block);
+        busy += recordThreadTimes(step->times, threads);
+
+        beginPhase(PHASE_ACCUMULATE);
+        memcpy(sums, step->accumulators, sizeof(double) * payload);
+        for (t = 1; t < threads; t++) {
+            const double* thread = step->accumulators + (size_t)t * step->stride;
+            for (i = 0; i < payload; i++) {
+                sums[i] += thread[i];
+            }
+        }
+        endPhase(PHASE_ACCUMULATE);
+        /* every process posts the same number of blocks, empty ones included */
+        beginPhase(PHASE_REDUCE);
+        MPI_Iallreduce(sums, blockResults + (size_t)b * payload, payload, MPI_DOUBLE, MPI_SUM, comm, &requests[b]);
+        /* give the reductions already posted a chance to progress */
+        MPI_Testall(b + 1, requests, &done, MPI_STATUSES_IGNORE);
+        endPhase(PHASE_REDUCE);
+    }
+    beginPhase(PHASE_REDUCE);
+    MPI_Waitall(blocks, requests, MPI_STATUSES_IGNORE);
+
+    memcpy(distributedCentroids, blockResults, sizeof(double) * payload);
+    for (b = 1; b < blocks; b++) {
+        const double* result = blockResults + (size_t)b * payload;
+        for (i = 0; i < payload; i++) {
+            distributedCentroids[i] += result[i];
+        }
+    }
+    endPhase(PHASE_REDUCE);
+    return busy;
+}
+
+/*
+ * turn the reduced sums and counts into the new centroids, store how far
+ * each one moved in drift and return the sum of the moves
+ */
+static double updateCentroids(double* distributedCentroids, int cluster, int dimension, double* centroids, double* drift) {
+    double* distributedPoints = distributedCentroids + cluster * dimension;
+    double sumDistance = 0;
+    int i, j;
+
+    for (i = 0; i < cluster; i++) {
+        drift[i] = 0;
+        /* an empty cluster keeps its centroid */
+        if (distributedPoints[i] == 0) {
+            continue;
+        }
+        /* calculate new centroids' average value */
+        for (j = 0; j < dimension; j++) {
+            distributedCentroids[i * dimension + j] /= distributedPoints[i];
+        }
+        /* update the difference sum and give the centroids new values */
+        drift[i] = sqrt(squaredDistance(distributedCentroids + i * dimension, centroids + i * dimension, dimension));
+        sumDistance += drift[i];
+        memcpy(centroids + i * dimension, distributedCentroids + i * dimension, sizeof(double) * dimension);
+    }
+    return sumDistance;
+}
+
+/*
+ * k-means over dense double vectors of any dimension spread over the
+ * processes of comm. Every process holds localRows rows and the same
+ * centroids, which are the seeds on entry and the result on return. The
+ * category of every local row is stored in categories. Returns the number
+ * of iterations.
+ */
+int vectorKMeans(MPI_Comm comm, double** rows, int* localRows, int dimension, int cluster,
+                 const KMeansOptions* options, double* centroids, int** categories) {
+    int i, t;
+    int iterations = 0;
+    /* how long the threads of this process took to assign and sum its rows, and whether rows just moved */
+    double busy = 0;
+    int rebalanced = 0;
+
+    if (options->miniBatch > 0) {
+        return vectorMiniBatch(comm, *rows, *localRows, dimension, cluster, options, centroids, *categories);
+    }
+
+    /* the centroid sums of every cluster followed by the point counts,
+     * packed together so that one collective reduces both. The delta mode
+     * adds the number of rows that changed cluster. */
+    int delta = options->delta;
+    int payload = cluster * (dimension + 1) + (delta ? 1 : 0);
+    /* the threads of this process and their own accumulators, merged into the first block */
+    ThreadPool* pool = createThreadPool(options->threads);
+    int threads = poolThreads(pool);
+    int stride;
+    double* newGeneratedCentroids = allocateThreadBlocks(threads, payload, sizeof(double), &stride);
+    /* the distributed centroids and points of all processors */
+    double* distributedCentroids = malloc(sizeof(double) * payload);
+    /* how far each centroid moved in the last update */
+    double* drift = malloc(sizeof(double) * cluster);
+
+    /* the delta mode keeps the sums of all rows, the same on every process, and
+     * the category every local row was summed under, none at the start */
+    double* totals = NULL;
+    int* previous = NULL;
+    double changed = 0;
+    if (delta) {
+        totals = calloc(payload, sizeof(double));
+        previous = malloc(sizeof(int) * (*localRows > 0 ? *localRows : 1));
+        for (i = 0; i < *localRows; i++) {
+            previous[i] = -1;
+        }
+    }
+
+    /* the bounds of the pruned assignment, see bounds.h */
+    int prune = options->prune;
+    double* upper = NULL;
+    double* lower = NULL;
+    double* separation = NULL;
+    double* halfDistances = NULL;
+    if (prune != PRUNE_NONE) {
+        upper = malloc(sizeof(double) * *localRows);
+        lower = malloc(sizeof(double) * *localRows * lowerBoundsPerRow(prune, cluster));
+        separation = malloc(sizeof(double) * cluster);
+        if (prune == PRUNE_ELKAN) {
+            halfDistances = malloc(sizeof(double) * cluster * cluster);
+        }
+    }
+    /* the bounds already skip most centroids, the index is for the full scan */
+    CentroidIndex* index = NULL;
+    if (prune == PRUNE_NONE && options->index == INDEX_KDTREE) {
+        index = createCentroidIndex(cluster, dimension);
+    }
+
+    /* the pipelined mode keeps the sums and the reduced sums of every block */
+    int blocks = options->pipeline > 1 ? options->pipeline : 1;
+    double* blockSums = NULL;
+    double* blockResults = NULL;
+    MPI_Request* requests = NULL;
+    if (blocks > 1) {
+        blockSums = malloc(sizeof(double) * payload * blocks);
+        blockResults = malloc(sizeof(double) * payload * blocks);
+        requests = malloc(sizeof(MPI_Request) * blocks);
+    }
+
+    ThreadTimes* times = malloc(sizeof(ThreadTimes) * threads);
+    VectorStep step = {*rows, *localRows, dimension, cluster, prune, 1, centroids, index, drift, halfDistances,
+                       separation, *categories, upper, lower, newGeneratedCentroids, stride, times, previous};
+
+    do {
+        /* the difference sum */
+        double sumDistance;
+
+        iterations++;
+        nextIteration();
+        /* the bounds start over on the first iteration and for rows that just moved */
+        step.first = iterations == 1 || rebalanced;
+        rebalanced = 0;
+        if (index != NULL) {
+            beginPhase(PHASE_UPDATE);
+            rebuildCentroidIndex(index, centroids);
+            endPhase(PHASE_UPDATE);
+        }
+
+        if (blocks > 1) {
+            busy += pipelinedVectorPass(comm, pool, &step, blocks,
+                                        prune != PRUNE_NONE ? lowerBoundsPerRow(prune, cluster) : 0,
+                                        payload, blockSums, blockResults, requests, distributedCentroids);
+        } else {
+            /* assign and sum every row, each thread its own share */
+            runThreadPool(pool, vectorStep, &step);
+            busy += recordThreadTimes(times, threads);
+            beginPhase(PHASE_ACCUMULATE);
+            for (t = 1; t < threads; t++) {
+                const double* block = newGeneratedCentroids + (size_t)t * stride;
+                for (i = 0; i < payload; i++) {
+                    newGeneratedCentroids[i] += block[i];
+                }
+            }
+            endPhase(PHASE_ACCUMULATE);
+
+            /* reduce step - the centroid sums and the cluster counts reach every process at once */
+            beginPhase(PHASE_REDUCE);
+            MPI_Allreduce(newGeneratedCentroids, distributedCentroids, payload, MPI_DOUBLE, MPI_SUM, comm);
+            endPhase(PHASE_REDUCE);
+        }
+
+        /* every process sees the same sums, so each one computes the new
+         * centroids and the termination itself instead of waiting for a broadcast */
+        beginPhase(PHASE_UPDATE);
+        if (delta) {
+            /* the reduced sums are the changes to the totals */
+            for (i = 0; i < payload - 1; i++) {
+                totals[i] += distributedCentroids[i];
+            }
+            changed = distributedCentroids[payload - 1];
+            /* the update turns the sums into means in place, so it gets a copy of the totals */
+            memcpy(distributedCentroids, totals, sizeof(double) * (payload - 1));
+        }
+        sumDistance = updateCentroids(distributedCentroids, cluster, dimension, centroids, drift);
+        endPhase(PHASE_UPDATE);
+
+        /* if the difference is less than a threshold, it is time to terminate */
+        if (sumDistance < TwoD_DIFF_THRESHOLD) {
+            break;
+        }
+        /* or if hardly any row changed cluster */
+        if (delta && iterations > 1 && changed <= options->minChanged) {
+            break;
+        }
+        if (options->maxIterations > 0 && iterations >= options->maxIterations) {
+            break;
+        }
+
+        /* the first iterations have shown how fast every process is, the faster ones take over rows */
+        if (iterations == options->rebalance &&
+            rebalanceRows(comm, (void**)rows, localRows, sizeof(double) * dimension, busy)) {
+            *categories = realloc(*categories, sizeof(int) * (*localRows > 0 ? *localRows : 1));
+            step.rows = *rows;
+            step.localRows = *localRows;
+            step.categories = *categories;
+            if (prune != PRUNE_NONE) {
+                upper = realloc(upper, sizeof(double) * (*localRows > 0 ? *localRows : 1));
+                lower = realloc(lower, sizeof(double) * (*localRows > 0 ? *localRows : 1) * lowerBoundsPerRow(prune, cluster));
+                step.upper = upper;
+                step.lower = lower;
+            }
+            if (delta) {
+                previous = realloc(previous, sizeof(int) * (*localRows > 0 ? *localRows : 1));
+                step.previous = previous;
+            }
+            rebalanced = 1;
+        }
+
+        /* the rows that moved and, every DELTA_REFRESH iterations, all rows are summed again from zero,
+         * so the rounding of the running sums cannot build up */
+        if (delta && (rebalanced || iterations % DELTA_REFRESH == 0)) {
+            memset(totals, 0, sizeof(double) * payload);
+            for (i = 0; i < *localRows; i++) {
+                previous[i] = -1;
+            }
+        }
+
+        /* the threads loosen the bounds by the drift at the start of the next iteration */
+        if (prune != PRUNE_NONE) {
+            beginPhase(PHASE_UPDATE);
+            centroidSeparation(centroids, cluster, dimension, halfDistances, separation);
+            endPhase(PHASE_UPDATE);
+        }
+    } while (1);
+    endIterations();
+
+    destroyThreadPool(pool);
+    free(times);
+    if (index != NULL) {
+        freeCentroidIndex(index);
+    }
+    free(newGeneratedCentroids);
+    free(distributedCentroids);
+    free(drift);
+    free(totals);
+    free(previous);
+    free(upper);
+    free(lower);
+    free(separation);
+    free(halfDistances);
+    free(blockSums);
+    free(blockResults);
+    free(requests);
+    return iterations;
+}
+
+/*
+ * k-means over the rows of a RowStream, read again in chunks on every
+ * iteration. Every process holds the same centroids, which are the seeds
+ * on entry and the result on return. The categories of the last
+ * assignment are written to labels, one int per local row, unless it is
+ * MPI_FILE_NULL. Returns the number of iterations.
+ */
+int vectorKMeansStream(MPI_Comm comm, RowStream* stream, int dimension, int cluster,
+                       const KMeansOptions* options, double* centroids, MPI_File labels) {
+    int i, t;
+    int iterations = 0;
+    int first, count;
+    const void* chunk;
+
+    int payload = cluster * (dimension + 1);
+    ThreadPool* pool = createThreadPool(options->threads);
+    int threads = poolThreads(pool);
+    int stride;
+    double* threadCentroids = allocateThreadBlocks(threads, payload, sizeof(double), &stride);
+    /* the sums of every chunk of this process */
+    double* newGeneratedCentroids = malloc(sizeof(double) * payload);
+    double* distributedCentroids = malloc(sizeof(double) * payload);
+    double* drift = malloc(sizeof(double) * cluster);
+    /* the categories of one chunk, on their way to labels */
+    int* categories = malloc(sizeof(int) * options->stream);
+
+    /* the bounds would need every row in memory, so only the index helps here */
+    CentroidIndex* index = NULL;
+    if (options->index == INDEX_KDTREE) {
+        index = createCentroidIndex(cluster, dimension);
+    }
+
+    ThreadTimes* times = malloc(sizeof(ThreadTimes) * threads);
+    VectorStep step = {NULL, 0, dimension, cluster, PRUNE_NONE, 1, centroids, index, NULL, NULL, NULL,
+                       categories, NULL, NULL, threadCentroids, stride, times, NULL};
+
+    do {
+        double sumDistance;
+
+        iterations++;
+        nextIteration();
+        memset(newGeneratedCentroids, 0, sizeof(double) * payload);
+        if (index != NULL) {
+            beginPhase(PHASE_UPDATE);
+            rebuildCentroidIndex(index, centroids);
+            endPhase(PHASE_UPDATE);
+        }
+
+        /* the next chunk is read while the threads work on this one */
+        beginPhase(PHASE_READ);
+        rewindRowStream(stream);
+        while ((chunk = nextRowChunk(stream, &first, &count)) != NULL) {
+            endPhase(PHASE_READ);
+            step.rows = chunk;
+            step.localRows = count;
+            runThreadPool(pool, vectorStep, &step);
+            recordThreadTimes(times, threads);
+            beginPhase(PHASE_ACCUMULATE);
+            for (t = 0; t < threads; t++) {
+                const double* block = threadCentroids + (size_t)t * stride;
+                for (i = 0; i < payload; i++) {
+                    newGeneratedCentroids[i] += block[i];
+                }
+            }
+            endPhase(PHASE_ACCUMULATE);
+            if (labels != MPI_FILE_NULL) {
+                beginPhase(PHASE_GATHER);
+                MPI_File_write_at(labels, (MPI_Offset)first * sizeof(int), categories, count, MPI_INT, MPI_STATUS_IGNORE);
+                endPhase(PHASE_GATHER);
+            }
+            beginPhase(PHASE_READ);
+        }
+        endPhase(PHASE_READ);
+
+        beginPhase(PHASE_REDUCE);
+        MPI_Allreduce(newGeneratedCentroids, distributedCentroids, payload, MPI_DOUBLE, MPI_SUM, comm);
+        endPhase(PHASE_REDUCE);
+        beginPhase(PHASE_UPDATE);
+        sumDistance = updateCentroids(distributedCentroids, cluster, dimension, centroids, drift);
+        endPhase(PHASE_UPDATE);
+
+        if (sumDistance < TwoD_DIFF_THRESHOLD) {
+            break;
+        }
+    } while (options->maxIterations == 0 || iterations < options->maxIterations);
+    endIterations();
+
+    destroyThreadPool(pool);
+    free(times);
+    if (index != NULL) {
+        freeCentroidIndex(index);
+    }
+    free(threadCentroids);
+    free(newGeneratedCentroids);
+    free(distributedCentroids);
+    free(drift);
+    free(categories);
+    return iterations;
+}
+
+/*
+ * the state one single precision iteration shares between the threads of a process
+ */
+typedef struct {
+    const float* rows;
+    int localRows;
+    int dimension;
+    int cluster;
+    /* the centroids in float, transposed, see vecdist.h */
+    const float* centroids;
+    int* categories;
+    /* one block of centroid sums followed by point counts per thread, stride doubles apart */
+    double* accumulators;
+    int stride;
+    ThreadTimes* times;
+} SingleStep;
+
+/*
+ * assign the float rows of one thread and add them to its own double accumulators
+ */
+static void singleStep(void* arg, int thread, int threads) {
+    SingleStep* step = arg;
+    int dimension = step->dimension;
+    double* sums = step->accumulators + (size_t)thread * step->stride;
+    double* points = sums + step->cluster * dimension;
+    ThreadTimes* times = step->times + thread;
+    double start = timerNow();
+    double assigned;
+    int begin, end;
+    int i, j;
+
+    threadRows(step->localRows, thread, threads, &begin, &end);
+
+    for (i = begin; i < end; i++) {
+        step->categories[i] = nearestCentroidSingle(step->rows + (size_t)i * dimension, step->centroids,
+                                                    step->cluster, dimension);
+    }
+    times->distances = (long long)(end - begin) * step->cluster;
+    assigned = timerNow();
+    times->assign = assigned - start;
+
+    memset(sums, 0, sizeof(double) * step->stride);
+    for (i = begin; i < end; i++) {
+        const float* point = step->rows + (size_t)i * dimension;
+        int category = step->categories[i];
+        points[category]++;
+        for (j = 0; j < dimension; j++) {
+            sums[category * dimension + j] += point[j];
+        }
+    }
+    times->accumulate = timerNow() - assigned;
+}
+
+/*
+ * k-means over float vectors spread over the processes of comm: the rows
+ * take half the memory and the distances run on twice the SIMD lanes,
+ * while the sums, the centroids and the termination stay in double as in
+ * vectorKMeans. Every process holds the same centroids, which are the
+ * seeds on entry and the result on return. The category of every local
+ * row is stored in categories. It runs the full assignment with
+ * options->threads and options->maxIterations only, the pruning, the
+ * index, the pipeline, the delta mode, the rebalancing and the
+ * mini-batches are not used. Returns the number of iterations.
+ */
+int vectorKMeansSingle(MPI_Comm comm, const float* rows, int localRows, int dimension, int cluster,
+                       const KMeansOptions* options, double* centroids, int* categories) {
+    int i, j, t;
+    int iterations = 0;
+
+    int payload = cluster * (dimension + 1);
+    ThreadPool* pool = createThreadPool(options->threads);
+    int threads = poolThreads(pool);
+    int stride;
+    double* newGeneratedCentroids = allocateThreadBlocks(threads, payload, sizeof(double), &stride);
+    double* distributedCentroids = malloc(sizeof(double) * payload);
+    double* drift = malloc(sizeof(double) * cluster);
+    float* transposed = malloc(sizeof(float) * cluster * dimension);
+
+    ThreadTimes* times = malloc(sizeof(ThreadTimes) * threads);
+    SingleStep step = {rows, localRows, dimension, cluster, transposed, categories, newGeneratedCentroids,
+                       stride, times};
+
+    do {
+        double sumDistance;
+
+        iterations++;
+        nextIteration();
+        /* the threads compare the rows with a float copy of the centroids */
+        beginPhase(PHASE_UPDATE);
+        for (i = 0; i < cluster; i++) {
+            for (j = 0; j < dimension; j++) {
+                transposed[(size_t)j * cluster + i] = (float)centroids[(size_t)i * dimension + j];
+            }
+        }
+        endPhase(PHASE_UPDATE);
+
+        runThreadPool(pool, singleStep, &step);
+        recordThreadTimes(times, threads);
+        beginPhase(PHASE_ACCUMULATE);
+        for (t = 1; t < threads; t++) {
+            const double* block = newGeneratedCentroids + (size_t)t * stride;
+            for (i = 0; i < payload; i++) {
+                newGeneratedCentroids[i] += block[i];
+            }
+        }
+        endPhase(PHASE_ACCUMULATE);
+
+        beginPhase(PHASE_REDUCE);
+        MPI_Allreduce(newGeneratedCentroids, distributedCentroids, payload, MPI_DOUBLE, MPI_SUM, comm);
+        endPhase(PHASE_REDUCE);
+        beginPhase(PHASE_UPDATE);
+        sumDistance = updateCentroids(distributedCentroids, cluster, dimension, centroids, drift);
+        endPhase(PHASE_UPDATE);
+
+        if (sumDistance < TwoD_DIFF_THRESHOLD) {
+            break;
+        }
+    } while (options->maxIterations == 0 || iterations < options->maxIterations);
+    endIterations();
+
+    destroyThreadPool(pool);
+    free(times);
+    free(newGeneratedCentroids);
+    free(distributedCentroids);
+    free(drift);
+    free(transposed);
+    return iterations;
+}
+
+/*
+ * the sum of the squared distances of the local rows to the centroids of their categories
+ */
+double vectorCost(const double* rows, int localRows, int dimension, const double* centroids, const int* categories) {
+    double cost = 0;
+    int i;
+
+    for (i = 0; i < localRows; i++) {
+        cost += squaredDistance(rows + (size_t)i * dimension, centroids + (size_t)categories[i] * dimension, dimension);
+    }
+    return cost;
+}
+
+/*
+ * the sum of the simplified silhouettes of the local rows: (b - a) / max(a, b)
+ * with a the distance to the centroid of the row and b to the nearest other one
+ */
+double vectorSilhouette(const double* rows, int localRows, int dimension, const double* centroids, int cluster,
+                        const int* categories) {
+    double sum = 0;
+    int i, c;
+
+    for (i = 0; i < localRows && cluster > 1; i++) {
+        const double* row = rows + (size_t)i * dimension;
+        double own = sqrt(squaredDistance(row, centroids + (size_t)categories[i] * dimension, dimension));
+        double other = -1;
+        for (c = 0; c < cluster; c++) {
+            double d;
+            if (c == categories[i]) {
+                continue;
+            }
+            d = squaredDistance(row, centroids + (size_t)c * dimension, dimension);
+            other = other < 0 || d < other ? d : other;
+        }
+        other = sqrt(other);
+        if (own != other) {
+            sum += (other - own) / (own > other ? own : other);
+        }
+    }
+    return sum;
+}
+
+/*
+ * vectorCost over float rows, summed in double
+ */
+double vectorCostSingle(const float* rows, int localRows, int dimension, const double* centroids, const int* categories) {
+    double cost = 0;
+    int i, j;
+
+    for (i = 0; i < localRows; i++) {
+        const float* row = rows + (size_t)i * dimension;
+        const double* centroid = centroids + (size_t)categories[i] * dimension;
+        for (j = 0; j < dimension; j++) {
+            double diff = row[j] - centroid[j];
+            cost += diff * diff;
+        }
+    }
+    return cost;
+}
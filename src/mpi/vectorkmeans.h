@@ -0,0 +1,63 @@
+#ifndef _VECTORKMEANS_H_
+#define _VECTORKMEANS_H_
+
+#include "mpi.h"
+#include "util.h"
+#include "rowstream.h"
+
+/* This is the threshold to end the calculation for points */
+#define TwoD_DIFF_THRESHOLD 0.000000001
+
+/* the delta mode sums every row again from zero this often */
+#define DELTA_REFRESH 16
+
+/*
+ * k-means over dense double vectors of any dimension spread over the
+ * processes of comm. Every process holds localRows rows and the same
+ * centroids, which are the seeds on entry and the result on return. The
+ * category of every local row is stored in categories. Returns the number
+ * of iterations. With options->miniBatch set, each iteration only uses a
+ * random batch of rows, see vectorMiniBatch. With options->rebalance set,
+ * rows move between the processes (see rebalance.h): rows, localRows and
+ * categories are then replaced, categories reallocated to match.
+ */
+int vectorKMeans(MPI_Comm comm, double** rows, int* localRows, int dimension, int cluster,
+                 const KMeansOptions* options, double* centroids, int** categories);
+
+/*
+ * k-means over the rows of a RowStream, read again in chunks of
+ * options->stream rows on every iteration. The categories of the last
+ * assignment are written to labels, one int per local row, unless it is
+ * MPI_FILE_NULL. Returns the number of iterations.
+ */
+int vectorKMeansStream(MPI_Comm comm, RowStream* stream, int dimension, int cluster,
+                       const KMeansOptions* options, double* centroids, MPI_File labels);
+
+/*
+ * k-means over float vectors with double sums and centroids, the rows take
+ * half the memory and the distances twice the SIMD lanes. It runs the
+ * full assignment with options->threads and options->maxIterations only,
+ * the other modes of vectorKMeans are not used. Returns the number of
+ * iterations.
+ */
+int vectorKMeansSingle(MPI_Comm comm, const float* rows, int localRows, int dimension, int cluster,
+                       const KMeansOptions* options, double* centroids, int* categories);
+
+/*
+ * the sum of the squared distances of the local rows to the centroids of their categories
+ */
+double vectorCost(const double* rows, int localRows, int dimension, const double* centroids, const int* categories);
+
+/*
+ * vectorCost over float rows, summed in double
+ */
+double vectorCostSingle(const float* rows, int localRows, int dimension, const double* centroids, const int* categories);
+
+/*
+ * the sum of the simplified silhouettes of the local rows: (b - a) / max(a, b)
+ * with a the distance to the centroid of the row and b to the nearest other one
+ */
+double vectorSilhouette(const double* rows, int localRows, int dimension, const double* centroids, int cluster,
+                        const int* categories);
+
+#endif